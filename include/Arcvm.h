@@ -12,6 +12,7 @@
 #include "Passes/CFResolutionPass.h"
 #include "Passes/ConstantPropogation.h"
 #include "Passes/ImmediateCanonicalization.h"
+#include "Passes/PurityAnalysis.h"
 
 #include <cstdint>
 #include <iostream>
@@ -64,7 +65,11 @@ class Arcvm {
     void run_canonicalization_passes();
 
     i32 run();
+    // decodes every loaded module once, each thread can then run it with an IRInterpreter of its own
+    FrozenModule freeze(bool profile = false);
+    // jit and compile are -1 without running or writing anything when the backend can't lower the module
     i32 jit();
+    i32 tiered(TierPolicy = {});
     i32 compile();
 
     template <typename P>
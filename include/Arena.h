@@ -0,0 +1,177 @@
+#ifndef ARCVM_ARENA_H
+#define ARCVM_ARENA_H
+
+// bump allocator made out of chunks that are never given back to the system
+//
+// memory is released by rewinding to an earlier mark, which keeps the chunks around
+// for the next allocations, so pointers are valid until the arena is rewound past them
+//
+// only uses the standard library since Common.h includes it for the IR nodes
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <vector>
+
+namespace arcvm {
+
+class Arena {
+  public:
+    struct Mark {
+        size_t chunk;
+        size_t offset;
+    };
+
+    Arena(size_t chunk_size = 64 * 1024): chunk_size{chunk_size} {}
+
+    Arena(Arena const&) = delete;
+    Arena& operator=(Arena const&) = delete;
+
+    inline void* allocate(size_t size, size_t alignment) {
+        auto aligned = (offset + alignment - 1) & ~(alignment - 1);
+        if(current < chunks.size() && aligned + size <= chunks[current].size) {
+            offset = aligned + size;
+            return chunks[current].data.get() + aligned;
+        }
+        return allocate_slow(size, alignment);
+    }
+
+    Mark mark() const { return Mark{current, offset}; }
+
+    // frees everything allocated after the mark was taken
+    void release(Mark mark) {
+        current = mark.chunk;
+        offset = mark.offset;
+    }
+
+    void reset() { release(Mark{0, 0}); }
+
+    // whether ptr is in memory handed out after from was taken and before to was
+    bool allocated_between(Mark from, Mark to, void const* ptr) const {
+        auto address = (uintptr_t)ptr;
+        for(auto i = from.chunk; i <= to.chunk && i < chunks.size(); ++i) {
+            auto data = (uintptr_t)chunks[i].data.get();
+            auto begin = i == from.chunk ? from.offset : 0;
+            auto end = i == to.chunk ? to.offset : chunks[i].size;
+            if(address >= data + begin && address < data + end)
+                return true;
+        }
+        return false;
+    }
+
+    // releases back to `to` but keeps what was allocated since `from`, copied to wherever the
+    // next allocation would have gone. returns how far it moved, pointers into it are for the caller to fix
+    // only memory in the current chunk can move, for anything else nothing is released
+    // alignment has to be the largest any of the kept allocations asked for
+    std::optional<std::ptrdiff_t> move_down(Mark from, Mark to, size_t alignment) {
+        if(from.chunk != current)
+            return std::nullopt;
+        if(current >= chunks.size() || from.offset >= offset) {
+            release(to);
+            return 0;
+        }
+        auto* kept = chunks[current].data.get() + ((from.offset + alignment - 1) & ~(alignment - 1));
+        auto size = (size_t)(chunks[current].data.get() + offset - kept);
+        release(to);
+        auto* destination = static_cast<std::byte*>(allocate(size, alignment));
+        std::memmove(destination, kept, size);
+        return (std::ptrdiff_t)((uintptr_t)destination - (uintptr_t)kept);
+    }
+
+    // bytes held in chunks, since they're never given back this is the most that was ever in use
+    size_t reserved() const {
+        size_t total = 0;
+        for(auto const& chunk : chunks)
+            total += chunk.size;
+        return total;
+    }
+
+  private:
+    struct Chunk {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+
+    size_t chunk_size;
+    std::vector<Chunk> chunks;
+    size_t current = 0;
+    size_t offset = 0;
+
+    // moves on to the next chunk that fits, making one if there isn't any
+    // new[] memory is aligned for any fundamental type so chunks start aligned
+    void* allocate_slow(size_t size, size_t alignment) {
+        while(++current < chunks.size()) {
+            if(size <= chunks[current].size) {
+                offset = size;
+                return chunks[current].data.get();
+            }
+        }
+        auto new_size = std::max(size + alignment, chunk_size);
+        chunks.push_back(Chunk{std::make_unique<std::byte[]>(new_size), new_size});
+        current = chunks.size() - 1;
+        offset = size;
+        return chunks[current].data.get();
+    }
+};
+
+// an Arena for objects with destructors, made for IR nodes that live exactly as long as their Module
+//
+// objects are never destroyed on their own, they all go at once when the arena does,
+// trivially destructible ones cost nothing to tear down and the rest one call per make
+class ObjectArena {
+  public:
+    ObjectArena() = default;
+
+    ObjectArena(ObjectArena const&) = delete;
+    ObjectArena& operator=(ObjectArena const&) = delete;
+
+    // newest first so nothing outlives what it was built from
+    ~ObjectArena() {
+        for(auto* destructor = destructors; destructor; destructor = destructor->next)
+            destructor->destroy(destructor->objects, destructor->count);
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        auto* object = new(arena.allocate(sizeof(T), alignof(T))) T{std::forward<Args>(args)...};
+        add_destructor(object, 1);
+        return object;
+    }
+
+    // count value initialized objects next to each other
+    template <typename T>
+    T* make_array(size_t count) {
+        auto* objects = static_cast<T*>(arena.allocate(sizeof(T) * count, alignof(T)));
+        std::uninitialized_value_construct_n(objects, count);
+        add_destructor(objects, count);
+        return objects;
+    }
+
+  private:
+    struct Destructor {
+        void (*destroy)(void*, size_t);
+        void* objects;
+        size_t count;
+        Destructor* next;
+    };
+
+    Arena arena;
+    Destructor* destructors = nullptr;
+
+    template <typename T>
+    void add_destructor(T* objects, size_t count) {
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            auto destroy = [](void* objects, size_t count) { std::destroy_n(static_cast<T*>(objects), count); };
+            destructors = make<Destructor>(destroy, objects, count, destructors);
+        }
+    }
+};
+
+};
+
+#endif
@@ -11,6 +11,15 @@ enum class ABIType : byte {
     linux_x64,
 };
 
+// the calling convention of the machine this is built for, what native code it runs has to follow
+constexpr ABIType host_abi() {
+#ifdef _WIN32
+    return ABIType::windows_x64;
+#else
+    return ABIType::linux_x64;
+#endif
+}
+
 class ABI {
   public:
     ABI(ABIType abi_type): abi_type{abi_type} {}
@@ -20,6 +29,7 @@ class ABI {
         if(abi_type == ABIType::windows_x64) {
             return {RegisterName::r11, RegisterName::r10, RegisterName::r9, RegisterName::r8, RegisterName::rdx, RegisterName::rcx, RegisterName::rax};
         }
+        return {RegisterName::r11, RegisterName::r10, RegisterName::r9, RegisterName::r8, RegisterName::rdi, RegisterName::rsi, RegisterName::rdx, RegisterName::rcx, RegisterName::rax};
     }
 
     std::vector<RegisterName> nonvolatile_register_list() {
@@ -27,6 +37,7 @@ class ABI {
             // TODO use rbp as general purpose
             return {RegisterName::r15, RegisterName::r14, RegisterName::r13, RegisterName::r12, RegisterName::rsi, RegisterName::rdi, RegisterName::rbx, /*RegisterName::rbp*/};
         }
+        return {RegisterName::r15, RegisterName::r14, RegisterName::r13, RegisterName::r12, RegisterName::rbx, /*RegisterName::rbp*/};
     }
 
   private:
@@ -5,6 +5,10 @@
 
 namespace arcvm {
 
+// a function compiled to native code, args points at the call's arguments in parameter order
+// the result is a whole register like an interpreted ret, narrower types come back sign extended
+using NativeFunction = i64 (*)(i64 const* args);
+
 template <typename T>
 concept Backend = requires(T t) {
     t.compile_module(static_cast<Module*>(nullptr));
@@ -24,14 +24,21 @@ class x86_64_Backend {
         free_nonvolatile_registers{abi.nonvolatile_register_list()}
     {}
 
+    ~x86_64_Backend();
+
     i32 run();
     void write_file(x86_64::FileFormat);
 
-    void compile_module(Module*);
-    void compile_function(Function*);
-    void compile_block(Block*);
-    void compile_basicblock(BasicBlock*);
-    int compile_entry(Entry*);
+    // for compiling single functions while something else runs the rest of the program
+    // nullptr for anything compile_entry doesn't handle yet
+    NativeFunction compile_native(Function*);
+
+    // these are false once an entry couldn't be lowered
+    bool compile_module(Module*);
+    bool compile_function(Function*);
+    bool compile_block(Block*);
+    bool compile_basicblock(BasicBlock*);
+    bool compile_entry(Entry*);
 
 
   private:
@@ -43,6 +50,8 @@ class x86_64_Backend {
     std::array<x86_64::Value, 100> val_table;
     std::vector<i32> disp_list;
     std::vector<byte> output;
+    // executable copies made by compile_native, freed with the backend
+    std::vector<std::pair<void*, size_t>> native_blocks;
 
     x86_64::RegisterName get_fvr() {
         if(free_volatile_registers.empty())
@@ -0,0 +1,62 @@
+#ifndef ARCVM_BATCH_INTERPRETER_H
+#define ARCVM_BATCH_INTERPRETER_H
+
+// runs one function over many independent inputs in lockstep
+//
+// every register holds one value per lane and each op runs over all the lanes at once,
+// with AVX2 or SSE2 kernels for the i64 operations when the compiler targets them.
+// ARCVM_BATCH_AVX2 builds for AVX2, otherwise x86_64 gets the SSE2 ones.
+// lanes that branch apart split into groups by the block they are at, the group at the lowest
+// pc runs its whole block with the rest masked off and groups that reach the same block merge
+//
+// only arithmetic and branches can run in lanes, functions that touch memory or call
+// run every input through a regular IRInterpreter instead
+
+#include "Common.h"
+#include "IRDecoder.h"
+#include "IRInterpreter.h"
+
+#include <span>
+
+namespace arcvm {
+
+class BatchInterpreter {
+  public:
+    // inputs are run this many at a time
+    static constexpr i32 lanes = 64;
+
+    BatchInterpreter(FrozenModule);
+
+    // args holds every input's arguments one input after another, results gets one value per input
+    void run_function(i32, std::span<i64 const> args, std::span<i64> results);
+
+    static bool can_batch(BytecodeFunction const&);
+
+  private:
+    FrozenModule bytecode_;
+    IRInterpreter fallback;
+
+    // lanes values per register slot, the lanes of one slot are contiguous
+    std::vector<i64> registers;
+
+    // lanes that are at the same block start, one bit per lane
+    struct LaneGroup {
+        i32 pc;
+        u64 members;
+    };
+    // highest pc first so the next group to run is at the back, never more than lanes of them
+    std::vector<LaneGroup> groups;
+    std::vector<i64> mask;  // all ones for the lanes running the current block, zero for the rest
+    std::vector<i64> taken; // outcome of the comparison of a br_<cmp> per lane
+
+    void run_lanes(BytecodeFunction const&, i64 const* args, i64* results, i32 count);
+    void add_lanes(i32 pc, u64 members);
+
+    inline i64* reg(i64 slot) {
+        return registers.data() + slot * lanes;
+    }
+};
+
+};
+
+#endif
@@ -15,7 +15,12 @@
 #include <string_view>
 #include <concepts>
 #include <cassert>
+#include <deque>
+#include <span>
+#include <unordered_map>
 
+#include "Arena.h"
+#include "SmallVector.h"
 
 namespace arcvm {
 
@@ -39,100 +44,60 @@ using i16 = int16_t;
 using i32 = int32_t;
 using i64 = int64_t;
 
+// every instruction in order
+// the enum, to_string and the interpreter's dispatch table are all generated from this list
+#define ARCVM_INSTRUCTIONS(X) \
+    X(alloc)                  \
+    X(load)                   \
+    X(store)                  \
+                              \
+    X(call)                   \
+    X(ret)                    \
+                              \
+    X(phi)                    \
+    X(dup)                    \
+    X(index)                  \
+                              \
+    X(br)                     \
+    X(brz)                    \
+    X(brnz)                   \
+                              \
+    ARCVM_BIN_OPS(X)          \
+                              \
+    X(neg)
+
+// binary operations, these stay contiguous in Instruction
+#define ARCVM_BIN_OPS(X) \
+    X(add)               \
+    X(sub)               \
+    X(mul)               \
+    X(div)               \
+    X(mod)               \
+    X(bin_or)            \
+    X(bin_and)           \
+    X(bin_xor)           \
+    X(lshift)            \
+    X(rshift)            \
+    X(lt)                \
+    X(gt)                \
+    X(lte)               \
+    X(gte)               \
+    X(eq)                \
+    X(neq)
+
 enum class Instruction : i8 {
-    alloc,
-    load,
-    store,
-
-    call,
-    ret,
-
-    phi,
-    dup,
-    index,
-
-    br,
-    brz,
-    brnz,
-
-    add,
-    sub,
-    mul,
-    div,
-    mod,
-    bin_or,
-    bin_and,
-    bin_xor,
-    lshift,
-    rshift,
-    lt,
-    gt,
-    lte,
-    gte,
-    eq,
-    neq,
-
-    neg,
+#define ARCVM_INSTRUCTION_ENUM(name) name,
+    ARCVM_INSTRUCTIONS(ARCVM_INSTRUCTION_ENUM)
+#undef ARCVM_INSTRUCTION_ENUM
 };
 
 static std::string to_string(Instruction instruction) {
     switch(instruction) {
-        case Instruction::alloc:
-            return "alloc";
-        case Instruction::load:
-            return "load";
-        case Instruction::store:
-            return "store";
-        case Instruction::call:
-            return "call";
-        case Instruction::ret:
-            return "ret";
-        case Instruction::phi:
-            return "phi";
-        case Instruction::dup:
-            return "dup";
-        case Instruction::index:
-            return "index";
-        case Instruction::br:
-            return "br";
-        case Instruction::brz:
-            return "brz";
-        case Instruction::brnz:
-            return "brnz";
-        case Instruction::add:
-            return "add";
-        case Instruction::sub:
-            return "sub";
-        case Instruction::mul:
-            return "mul";
-        case Instruction::div:
-            return "div";
-        case Instruction::mod:
-            return "mod";
-        case Instruction::bin_or:
-            return "bin_or";
-        case Instruction::bin_and:
-            return "bin_and";
-        case Instruction::bin_xor:
-            return "bin_xor";
-        case Instruction::lshift:
-            return "lshift";
-        case Instruction::rshift:
-            return "rshift";
-        case Instruction::lt:
-            return "lt";
-        case Instruction::gt:
-            return "gt";
-        case Instruction::lte:
-            return "lte";
-        case Instruction::gte:
-            return "gte";
-        case Instruction::eq:
-            return "eq";
-        case Instruction::neq:
-            return "neq";
-        case Instruction::neg:
-            return "neg";
+#define ARCVM_INSTRUCTION_STRING(name) \
+        case Instruction::name:        \
+            return #name;
+        ARCVM_INSTRUCTIONS(ARCVM_INSTRUCTION_STRING)
+#undef ARCVM_INSTRUCTION_STRING
         default:
             return "";
     }
@@ -213,14 +178,49 @@ static i32 type_size(Type type) {
 
 enum class IRValueType : i8 { none, pointer, reference, immediate, type, fn_name, label };
 
+// a label or function name, a Module keeps exactly one per distinct string
+// so two symbols from the same Module are equal only if they are the same pointer
+struct Symbol {
+    std::string name;
+    u32 id;     // dense per Module in the order they were interned, for indexing arrays
+};
+
+class SymbolTable {
+  public:
+    Symbol const* intern(std::string_view name) {
+        if(auto it = symbols.find(name); it != symbols.end())
+            return it->second;
+        auto* symbol = &storage.emplace_back(Symbol{std::string{name}, (u32)storage.size()});
+        symbols.emplace(symbol->name, symbol);
+        return symbol;
+    }
+
+    // nullptr if the name was never interned
+    Symbol const* find(std::string_view name) const {
+        auto it = symbols.find(name);
+        return it == symbols.end() ? nullptr : it->second;
+    }
+
+    Symbol const* operator[](u32 id) const { return &storage[id]; }
+    size_t size() const { return storage.size(); }
+
+  private:
+    std::deque<Symbol> storage;     // never moves a Symbol once it is in
+    std::unordered_map<std::string_view, Symbol const*> symbols;    // keys view the names in storage
+};
+
 // FIXME does not work with float immediate values
 struct IRValue {
     IRValueType type;
+    // labels and fn_names hold symbol once interned, str_value is only there for ones built from a string
+    // BasicBlock::gen_inst interns those so every operand in an Entry is interned
+    bool interned = false;
     union {
         i64 value;
         uintptr_t pointer_value;
         Type type_value;
         std::string* str_value;
+        Symbol const* symbol;
     };
 
     IRValue(): type{IRValueType::none} {}
@@ -233,51 +233,220 @@ struct IRValue {
     IRValue(IRValueType type, Type type_value): type(type), type_value(type_value) {}
     IRValue(Type type_value): type(IRValueType::type), type_value(type_value) {}
     IRValue(std::string* str): type(IRValueType::label), str_value(str) {}
+    IRValue(IRValueType type, Symbol const* symbol): type(type), interned(true), symbol(symbol) {}
+
+    // label or fn_name, either way it was built
+    std::string_view name() const { return interned ? std::string_view{symbol->name} : std::string_view{*str_value}; }
+};
+
+// references and pointers are the SSA values of a function, numbered below Function::value_count
+inline bool is_value(IRValue value) {
+    return value.type == IRValueType::reference || value.type == IRValueType::pointer;
+}
+
+class Entry;
+
+// an argument of an Entry that reads an SSA value, linked into that value's list of uses
+struct Use {
+    Entry* user;
+    u32 operand;            // index into user->arguments()
+    Use* prev = nullptr;
+    Use* next = nullptr;
 };
 
-struct Entry {
-    IRValue dest;
-    Instruction instruction;
-    std::vector<IRValue> arguments;
+// def-use chain of one SSA value
+struct ValueInfo {
+    Entry* def = nullptr;   // nullptr for parameters
+    Use* uses = nullptr;    // first use, in no particular order
 };
 
+// only its block writes to an entry, through BasicBlock and Block, so the block's columns
+// and the def-use chains always agree with it
+class Entry {
+  public:
+    // three covers everything but calls with more than one argument and phis with more than one predecessor
+    using Arguments = SmallVector<IRValue, 3>;
+
+    IRValue const& dest() const { return dest_; }
+    Instruction instruction() const { return instruction_; }
+    // a slice of the operand pool of the entry's block
+    std::span<IRValue const> arguments() const { return {arguments_, argument_count}; }
+    // one per argument, the ones for arguments that are values are linked into ValueInfo::uses
+    Use const* uses() const { return uses_; }
+
+  private:
+    friend struct BasicBlock;
+    friend struct Block;
+
+    IRValue dest_;
+    Instruction instruction_{};
+    u32 argument_count = 0;
+    IRValue* arguments_ = nullptr;
+    Use* uses_ = nullptr;
+};
+
+// the type argument an entry was given, the last argument when there is one
+inline Type explicit_type(std::span<IRValue const> arguments) {
+    if(!arguments.empty() && arguments.back().type == IRValueType::type)
+        return arguments.back().type_value;
+    return Type::none;
+}
+
+inline Type explicit_type(Entry const& entry) {
+    return explicit_type(entry.arguments());
+}
+
 struct Label {
-    std::string name;
+    Symbol const* symbol;
+    std::string const& name;    // the symbol's
 };
 // TODO maybe have a pointer to the parent block?
 struct BasicBlock {
     Label label;
-    std::vector<Entry*> entries;
     i32& var_name;
+    std::vector<ValueInfo>& values;     // the Block's
+    ObjectArena& arena;     // the Module's, everything in the block is allocated from it
+    SymbolTable& symbols;   // the Module's
+    i32 id = -1;    // dense per function in creation order, unlike the position in Block::blocks
+
+    // copies of the fields of entries one array per field, index i is entries()[i]
+    // scans that only look at opcodes, results or types read these instead of chasing every Entry*
+    // entries can only change through the members below so these stay in step, see columns_match
+    std::vector<Instruction> instructions;
+    std::vector<IRValue> dests;
+    std::vector<Type> types;    // explicit_type of the entry
+    std::vector<bool> removed;  // tombstones, see remove_entry
+
+    BasicBlock(Symbol const* label_, std::vector<Entry*> initial_entries, i32& var_name_, std::vector<ValueInfo>& values_,
+               ObjectArena& arena_, SymbolTable& symbols_):
+        label{label_, label_->name}, var_name{var_name_}, values{values_}, arena{arena_}, symbols{symbols_},
+        entries_{std::move(initial_entries)} {
+        for(auto* entry : entries_) {
+            push_columns(*entry);
+            link(entry);
+        }
+    }
 
-    BasicBlock(std::string label_name, std::vector<Entry*> entries_, i32& var_name_):
-        label{label_name}, entries{entries_}, var_name{var_name_} {}
+    std::vector<Entry*> const& entries() const { return entries_; }
 
     IRValue gen_inst(Instruction, IRValue);
-    IRValue gen_inst(Instruction, std::vector<IRValue>);
+    IRValue gen_inst(Instruction, Entry::Arguments);
+    // a label operand naming this block
+    IRValue label_value();
+
+    // these keep the columns above and the def-use chains up to date
+    //
+    // removing and inserting are O(1) and leave entries and every position in it as they are,
+    // a removed entry is only marked and an inserted one waits in pending_inserts, both until compact()
+    // so a pass can keep walking by index while it edits. PassManager compacts after every pass
+    void append_entry(IRValue dest, Instruction, Entry::Arguments const&);
+    void replace_entry(size_t, IRValue dest, Instruction, Entry::Arguments const&);
+    void remove_entry(size_t);
+    // goes in before position index, which is a position from before any of the pending changes
+    void insert_entry(size_t, IRValue dest, Instruction, Entry::Arguments const&);
+    // removes every entry pred is true for, in one pass
+    template <typename Pred>
+    void remove_entries_if(Pred pred);
+    // drops the removed entries and places the inserted ones
+    void compact();
+    bool is_compact() const { return removed_count == 0 && pending_inserts.empty(); }
+    // removed entries stay in entries() until compact(), everything that walks them has to skip these
+    bool is_removed(size_t index) const { return removed[index]; }
+    // whether every entry that isn't removed still agrees with its columns
+    // they can only drift apart if an Entry was written to directly, checked by asserts
+    bool columns_match() const;
+
+    // records entry as the def of its dest and as a use of each of its arguments that is a value
+    // uses is an array of one Use per argument to fill in, a new one comes from the arena without it
+    void link(Entry*, Use* uses = nullptr);
+    void unlink(Entry*);
+
+  private:
+    Entry* new_entry(IRValue, Instruction, Entry::Arguments const&);
+    IRValue* new_operands(u32);
+    void push_columns(Entry const&);
+
+    std::vector<Entry*> entries_;
+
+    u32 removed_count = 0;
+    std::vector<std::pair<size_t, Entry*>> pending_inserts;
+
+    // entries come from runs that belong to this block so they sit next to each other
+    // even when several blocks are generated at the same time
+    Entry* entry_run = nullptr;
+    i32 entry_run_left = 0;
+    i32 entry_run_size = 0;
+    // the operand pool, arguments of the block's entries are handed out of runs the same way
+    // so a scan over them walks memory in order. replacing an entry with a different number
+    // of arguments leaves its old ones unused in the run
+    IRValue* operand_run = nullptr;
+    i32 operand_run_left = 0;
+    i32 operand_run_size = 0;
 };
 
 struct Block {
+    // in layout order, a block made after one that isn't the last waits in pending_blocks until compact()
     std::vector<BasicBlock*> blocks;
     i32 var_name = 0;
     i32 label_name = 0;
-    i32 insertion_point = -1;
+    BasicBlock* insertion_point = nullptr;  // new blocks go right after it and become it
+    i32 block_count = 0;
+    ObjectArena* arena = nullptr;
+    SymbolTable* symbols = nullptr;
+    // indexed by value number, grows as values are defined and used
+    std::vector<ValueInfo> values;
 
     void set_insertion_point(BasicBlock*);
     void set_insertion_point(std::string);
+    // a position in blocks, so the pending blocks are placed first
     void set_insertion_point(i32);
     BasicBlock* new_basic_block();
     BasicBlock* new_basic_block(std::string);
-    BasicBlock* get_bblock() { return blocks[insertion_point]; }
+    BasicBlock* get_bblock() { return insertion_point; }
     void gen_if(IRValue, BasicBlock*, BasicBlock*, BasicBlock*);
+    // places the pending blocks and compacts every block
+    void compact();
+    bool is_compact() const;
+
+    ValueInfo& value_info(i64 value);
+    // operand of an entry in this function, relinks its use
+    // type arguments are part of the instruction like its opcode, those change through replace_entry
+    void set_argument(Entry*, u32, IRValue);
+    // rewrites every use of value to replacement, it has no uses afterwards
+    // calls on_use with each entry that had a use, before moving on to the next
+    template <typename F>
+    void replace_all_uses(i64 value, IRValue replacement, F&& on_use) {
+        auto* use = value_info(value).uses;
+        while(use) {
+            auto* next = use->next;
+            set_argument(use->user, use->operand, replacement);
+            on_use(use->user);
+            use = next;
+        }
+    }
+
+  private:
+    // each with the block it goes right after, in the order they were made
+    std::vector<std::pair<BasicBlock*, BasicBlock*>> pending_blocks;
 };
 
-enum class Attribute : i8 { entrypoint };
+template <typename Pred>
+void BasicBlock::remove_entries_if(Pred pred) {
+    for(size_t i = 0; i < entries_.size(); ++i)
+        if(!removed[i] && pred(entries_[i]))
+            remove_entry(i);
+    compact();
+}
+
+// pure is set by PurityAnalysis, the result only depends on the arguments
+enum class Attribute : i8 { entrypoint, pure };
 
 static std::string to_string(Attribute attribute) {
     switch (attribute) {
         case Attribute::entrypoint:
             return "entrypoint";
+        case Attribute::pure:
+            return "pure";
         default:
             return "";
     }
@@ -285,39 +454,42 @@ static std::string to_string(Attribute attribute) {
 
 struct Function {
     std::string name;
-    std::vector<Type> parameters;
-    Type return_type;
-    std::vector<Attribute> attributes;
+    std::vector<Type> parameters{};
+    Type return_type = Type::none;
+    std::vector<Attribute> attributes{};
 
     //FIXME write constructors
-    Block* block{new Block{{}, (i32)parameters.size()}};
+    Block* block = nullptr;     // set by Module::gen_function_def
 
     Block* get_block() { return block; }
     void add_attribute(Attribute attribute) { attributes.push_back(attribute); }
     IRValue get_param(i32);
+    // number of SSA values including the parameters, every value is numbered below this
+    i32 value_count() { return block->var_name; }
 };
 
+// owns every Function, Block, BasicBlock and Entry in it, they are all freed together when the Module is deleted
+// labels and function names used in it are interned in symbols
 struct Module {
+    ObjectArena arena;
+    SymbolTable symbols;
     std::vector<Function*> functions;
 
+    // operands naming a block or a function, by name
+    IRValue label(std::string_view name) { return IRValue{IRValueType::label, symbols.intern(name)}; }
+    IRValue function_name(std::string_view name) { return IRValue{IRValueType::fn_name, symbols.intern(name)}; }
+
     Function* gen_function_def(std::string, std::vector<Type>, Type);
     Function* gen_aggregate_def(std::string, std::vector<Type>);
+    // settles the pending removals and insertions of every block, see BasicBlock::remove_entry
+    void compact();
+    bool is_compact() const;
 };
 
 struct CompiledModule {
 
 };
 
-// TODO use allocator
-inline void replace_entry(std::vector<Entry*>& entries, size_t index, Entry new_entry) {
-    delete entries[index];
-    entries[index] = new Entry{new_entry};
-}
-
-inline void remove_entry(std::vector<Entry*>& entries, size_t index) {
-    entries.erase(entries.begin() + index);
-}
-
 
 };
 
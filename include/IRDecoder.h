@@ -0,0 +1,339 @@
+#ifndef ARCVM_IRDECODER_H
+#define ARCVM_IRDECODER_H
+
+// lowers the Entry* graph of a Module into flat per-function bytecode for the interpreter
+//
+// any number of modules can be decoded into one BytecodeModule, function names are global
+// across all of them so a call can go to a function defined in another module
+//
+// branch targets become op offsets, callees become function indices and operands
+// become register slots or inline immediates, so the interpreter never touches a string
+
+#include "Common.h"
+#include "TypedOps.h"
+
+#include <iterator>
+#include <memory>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+
+namespace arcvm {
+
+// comparisons, these stay contiguous in Instruction
+#define ARCVM_CMP_OPS(X) \
+    X(lt)                \
+    X(gt)                \
+    X(lte)               \
+    X(gte)               \
+    X(eq)                \
+    X(neq)
+
+// fused sequences of ops, the patterns they replace are in Superinstructions.cpp
+#define ARCVM_SUPERINSTRUCTIONS(X) \
+    X(br_lt)                       \
+    X(br_gt)                       \
+    X(br_lte)                      \
+    X(br_gte)                      \
+    X(br_eq)                       \
+    X(br_neq)                      \
+    X(tail_call)
+
+// the widths memory is accessed at, signed and unsigned types of the same width share one
+#define ARCVM_MEMORY_TYPES(X, name) \
+    X(name, i8)                     \
+    X(name, i16)                    \
+    X(name, i32)                    \
+    X(name, i64)
+
+constexpr i32 memory_type_count = 4;
+
+// position of a type in ARCVM_MEMORY_TYPES, untyped loads and stores access a whole i64
+inline i32 memory_type_index(Type type) {
+    switch(type) {
+        case Type::ir_b1:
+        case Type::ir_b8:
+        case Type::ir_i8:
+        case Type::ir_u8:
+            return 0;
+        case Type::ir_i16:
+        case Type::ir_u16:
+            return 1;
+        case Type::ir_i32:
+        case Type::ir_u32:
+            return 2;
+        default:
+            return 3;
+    }
+}
+
+// memory ops that get one opcode per width, e.g. load_i32
+#define ARCVM_MEMORY_OPS(X) \
+    X(load)                 \
+    X(store)
+
+// superinstructions that access memory, these get one opcode per width as well
+#define ARCVM_FUSED_MEMORY_OPS(X) \
+    X(alloc_store)                \
+    X(inc_mem)
+
+// ops with no Instruction behind them, count is only emitted when profiling
+// br_back is a br that closes a loop, every backedge goes through one
+#define ARCVM_PROFILE_OPS(X) \
+    X(count)                 \
+    X(br_back)
+
+// the first opcodes mirror Instruction one to one, after them every binary operation
+// gets one opcode per result type, e.g. add_i32, so the handler never looks at the type
+// superinstructions, loads, stores and fused memory ops of each width, load_<op>_store of each
+// binary operation and width, e.g. load_add_store_i32, and profiling ops come last
+enum class OpCode : u8 {
+#define ARCVM_OPCODE_ENUM(name) name,
+#define ARCVM_TYPED_OPCODE_ENUM(name, type) name##_##type,
+#define ARCVM_TYPED_BIN_OP_ENUM(name) ARCVM_INTEGRAL_TYPES(ARCVM_TYPED_OPCODE_ENUM, name)
+#define ARCVM_TYPED_MEMORY_OP_ENUM(name) ARCVM_MEMORY_TYPES(ARCVM_TYPED_OPCODE_ENUM, name)
+#define ARCVM_LOAD_OP_STORE_ENUM(name) ARCVM_MEMORY_TYPES(ARCVM_TYPED_OPCODE_ENUM, load_##name##_store)
+    ARCVM_INSTRUCTIONS(ARCVM_OPCODE_ENUM)
+    ARCVM_BIN_OPS(ARCVM_TYPED_BIN_OP_ENUM)
+    ARCVM_SUPERINSTRUCTIONS(ARCVM_OPCODE_ENUM)
+    ARCVM_MEMORY_OPS(ARCVM_TYPED_MEMORY_OP_ENUM)
+    ARCVM_FUSED_MEMORY_OPS(ARCVM_TYPED_MEMORY_OP_ENUM)
+    ARCVM_BIN_OPS(ARCVM_LOAD_OP_STORE_ENUM)
+    ARCVM_PROFILE_OPS(ARCVM_OPCODE_ENUM)
+#undef ARCVM_LOAD_OP_STORE_ENUM
+#undef ARCVM_TYPED_MEMORY_OP_ENUM
+#undef ARCVM_TYPED_BIN_OP_ENUM
+#undef ARCVM_TYPED_OPCODE_ENUM
+#undef ARCVM_OPCODE_ENUM
+};
+
+inline constexpr std::string_view opcode_names[] = {
+#define ARCVM_OPCODE_NAME(name) #name,
+#define ARCVM_TYPED_OPCODE_NAME(name, type) #name "_" #type,
+#define ARCVM_TYPED_BIN_OP_NAME(name) ARCVM_INTEGRAL_TYPES(ARCVM_TYPED_OPCODE_NAME, name)
+#define ARCVM_TYPED_MEMORY_OP_NAME(name) ARCVM_MEMORY_TYPES(ARCVM_TYPED_OPCODE_NAME, name)
+#define ARCVM_LOAD_OP_STORE_NAME(name) ARCVM_MEMORY_TYPES(ARCVM_TYPED_OPCODE_NAME, load_##name##_store)
+    ARCVM_INSTRUCTIONS(ARCVM_OPCODE_NAME)
+    ARCVM_BIN_OPS(ARCVM_TYPED_BIN_OP_NAME)
+    ARCVM_SUPERINSTRUCTIONS(ARCVM_OPCODE_NAME)
+    ARCVM_MEMORY_OPS(ARCVM_TYPED_MEMORY_OP_NAME)
+    ARCVM_FUSED_MEMORY_OPS(ARCVM_TYPED_MEMORY_OP_NAME)
+    ARCVM_BIN_OPS(ARCVM_LOAD_OP_STORE_NAME)
+    ARCVM_PROFILE_OPS(ARCVM_OPCODE_NAME)
+#undef ARCVM_LOAD_OP_STORE_NAME
+#undef ARCVM_TYPED_MEMORY_OP_NAME
+#undef ARCVM_TYPED_BIN_OP_NAME
+#undef ARCVM_TYPED_OPCODE_NAME
+#undef ARCVM_OPCODE_NAME
+};
+
+constexpr size_t opcode_count = std::size(opcode_names);
+
+inline std::string_view to_string(OpCode opcode) {
+    return opcode_names[(size_t)opcode];
+}
+
+inline OpCode to_opcode(Instruction instruction) {
+    return static_cast<OpCode>(instruction);
+}
+
+inline OpCode typed_opcode(Instruction instruction, Type type) {
+    auto first = (i32)OpCode::add_i8;
+    return static_cast<OpCode>(first + bin_op_index(instruction) * integral_type_count + integral_type_index(type));
+}
+
+// opcode is load or store
+inline OpCode typed_memory_opcode(OpCode opcode, Type type) {
+    auto first = opcode == OpCode::load ? (i32)OpCode::load_i8 : (i32)OpCode::store_i8;
+    return static_cast<OpCode>(first + memory_type_index(type));
+}
+
+// the width of alloc_store or inc_mem picked for type
+inline OpCode alloc_store_opcode(Type type) {
+    return static_cast<OpCode>((i32)OpCode::alloc_store_i8 + memory_type_index(type));
+}
+
+inline OpCode inc_mem_opcode(Type type) {
+    return static_cast<OpCode>((i32)OpCode::inc_mem_i8 + memory_type_index(type));
+}
+
+inline bool is_alloc_store(OpCode opcode) {
+    return opcode >= OpCode::alloc_store_i8 && opcode <= OpCode::alloc_store_i64;
+}
+
+inline bool is_inc_mem(OpCode opcode) {
+    return opcode >= OpCode::inc_mem_i8 && opcode <= OpCode::inc_mem_i64;
+}
+
+inline OpCode load_op_store_opcode(Instruction instruction, Type type) {
+    auto first = (i32)OpCode::load_add_store_i8;
+    return static_cast<OpCode>(first + bin_op_index(instruction) * memory_type_count + memory_type_index(type));
+}
+
+inline bool is_load_op_store(OpCode opcode) {
+    return opcode >= OpCode::load_add_store_i8 && opcode <= OpCode::load_neq_store_i64;
+}
+
+inline bool is_typed_bin_op(OpCode opcode) {
+    return opcode >= OpCode::add_i8 && opcode < OpCode::br_lt;
+}
+
+// the Instruction a typed opcode was made from
+inline Instruction typed_opcode_instruction(OpCode opcode) {
+    auto index = ((i32)opcode - (i32)OpCode::add_i8) / integral_type_count;
+    return static_cast<Instruction>((i32)Instruction::add + index);
+}
+
+inline bool is_branch(OpCode opcode) {
+    switch(opcode) {
+        case OpCode::br:
+        case OpCode::br_back:
+        case OpCode::brz:
+        case OpCode::brnz:
+#define ARCVM_CMP_BRANCH_CASE(name) case OpCode::br_##name:
+        ARCVM_CMP_OPS(ARCVM_CMP_BRANCH_CASE)
+#undef ARCVM_CMP_BRANCH_CASE
+            return true;
+        default:
+            return false;
+    }
+}
+
+// branches with only the target in x
+inline bool is_unconditional_branch(OpCode opcode) {
+    return opcode == OpCode::br || opcode == OpCode::br_back;
+}
+
+enum class OperandKind : u8 { none, reg, imm };
+
+struct Operand {
+    OperandKind kind;
+    i64 value;
+};
+
+// what x and y mean depends on the opcode
+//   br         x: target offset
+//   brz/brnz   x: taken offset                 y: other offset
+//   call       x: first argument in the pool   y: argument count   a: callee, see BytecodeModule
+//
+//   br_<cmp>       x: offset taken if a <cmp> b    y: other offset
+//   tail_call      same as call, the callee replaces the current frame and returns to its caller
+//                  the frame's memory is released first except for what the arguments point into,
+//                  unless BytecodeFunction::allocations_escape
+//   count          x: profile counter to increment
+//   br_back        same as br, the target is laid out at or before the block the branch is in
+//   load_<width>   load with the width it accesses memory at in the opcode, store_<width> the same for store
+//   alloc_store_<width>        x: bytes to allocate    b: initial value, stored at width
+//   inc_mem_<width>            *a = *a + b, b is an immediate
+//   load_<op>_store_<width>    *a = *a op b, only fused when op's type is at least width wide
+//                              so truncating to width is all its type would do
+//   memory is accessed as type in all of them
+//
+// phi is never emitted, each phi becomes a dup on every edge into its block
+// other than a of call/tail_call and b of inc_mem, a and b are always registers once decoded
+// immediates are moved into BytecodeFunction::constants
+struct Op {
+    OpCode opcode;
+    Type type = Type::none;     // explicit type argument if there was one
+    OperandKind a_kind = OperandKind::none;
+    OperandKind b_kind = OperandKind::none;
+    i32 dest = -1;              // register slot, -1 if the instruction has no result
+    i64 a = 0;
+    i64 b = 0;
+    i32 x = 0;
+    i32 y = 0;
+};
+
+// copies everything it needs out of its Function, the IR can change or go away once it's decoded
+struct BytecodeFunction {
+    std::string name;
+    i32 register_count = 0;
+    std::vector<Op> code{};
+    std::vector<Operand> operand_pool{};
+    std::vector<i32> block_offsets{};   // indexed by BasicBlock::id, followed by edge blocks
+    std::vector<i32> op_blocks{};       // indexed like code, the block_offsets index of the block each op is in
+    std::vector<std::string> block_labels{};    // indexed by BasicBlock::id
+    std::vector<i32> block_layout{};    // BasicBlock::ids in the order of Block::blocks
+    // every immediate operand reads one of these, they are copied into the registers
+    // starting at constant_base whenever a frame for the function is entered
+    std::vector<i64> constants{};
+    i32 constant_base = 0;
+    bool pure = false;      // has Attribute::pure, so calls to it can be memoized
+    i32 parameter_count = 0;
+    // a pointer into memory the function allocs may be stored or passed to a call that keeps it,
+    // parameters_escape is the same for a pointer it gets as an argument. tail calls don't count,
+    // the interpreter checks what their arguments point into when they run
+    bool allocations_escape = true;
+    bool parameters_escape = true;
+};
+
+enum class ProfileKind : u8 { block, taken, not_taken, call };
+
+// what one profile counter counts, taken and not_taken are the edges out of a brz/brnz
+struct ProfilePoint {
+    ProfileKind kind;
+    i32 function;       // index into BytecodeModule::functions
+    i32 block;          // BasicBlock::id, for edges and calls the block they are in
+    i32 callee = -1;    // index into BytecodeModule::functions
+};
+
+// every call holds a BytecodeFunction const* to its callee so calls never look anything up
+// moving keeps those valid but a copy would still point into the original, so modules are move only
+struct BytecodeModule {
+    std::vector<BytecodeFunction> functions;
+    i32 entrypoint = -1;
+    std::vector<ProfilePoint> profile_points{};     // empty unless decoded with profiling on
+
+    BytecodeModule() = default;
+    BytecodeModule(BytecodeModule const&) = delete;
+    BytecodeModule(BytecodeModule&&) = default;
+    BytecodeModule& operator=(BytecodeModule const&) = delete;
+    BytecodeModule& operator=(BytecodeModule&&) = default;
+};
+
+// a decoded program that is never written to again
+// any number of interpreters on any number of threads can run the same one at once
+using FrozenModule = std::shared_ptr<BytecodeModule const>;
+
+class IRDecoder {
+  public:
+    // profiling adds a count op at every block entry, brz/brnz edge and call site
+    IRDecoder(bool profile = false): profile{profile} {}
+
+    // only reads the modules, they have to be compacted first, see Module::compact
+    BytecodeModule decode(Module*);
+    BytecodeModule decode(std::vector<Module*> const&);
+    FrozenModule freeze(std::vector<Module*> const&);
+
+  private:
+    bool profile;
+    std::vector<ProfilePoint> profile_points;
+    i32 function_index = -1;
+
+    std::unordered_map<std::string, i32> function_indices;
+    // indexed by Symbol::id of the Module being decoded
+    std::vector<i32> block_ids;
+    std::vector<i32> callee_indices;
+    SymbolTable const* callee_symbols = nullptr;    // the table callee_indices was built for
+    std::vector<std::vector<Entry*>> phis;
+    std::vector<i32> layout_positions;  // index in Block::blocks, by BasicBlock::id
+    std::vector<std::tuple<i32, i32, i32>> edge_blocks;  // from, to and the counter for the edge, or -1
+    i32 scratch_count = 0;
+
+    BytecodeFunction decode_function(Function*);
+    void materialize_constants(BytecodeFunction&);
+    static bool escapes(BytecodeFunction const&, bool from_parameters);
+    static void find_escapes(BytecodeModule&);
+    Op decode_entry(Entry*, i32, BytecodeFunction&);
+    i32 decode_target(i32, i32, ProfileKind);
+    bool is_backedge(i32 from, i32 to) const;
+    Op decode_count(ProfileKind, i32, i32 callee = -1);
+    void decode_edge(i32, i32, BytecodeFunction&);
+    Operand decode_operand(IRValue);
+    i32 decode_label(IRValue);
+    i32 decode_callee(IRValue);
+};
+
+};
+
+#endif
@@ -8,9 +8,14 @@
 namespace arcvm {
 
 // TODO make generating code from multiple threads more friendly
+// owns the modules it creates, they are deleted along with it
 class IRGenerator {
   public:
     IRGenerator();
+    ~IRGenerator();
+
+    IRGenerator(IRGenerator const&) = delete;
+    IRGenerator& operator=(IRGenerator const&) = delete;
 
     Module* create_module();
     void link_modules();
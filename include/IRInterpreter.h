@@ -2,57 +2,176 @@
 #define ARCVM_IRINTERPRETER_H
 
 #include "Common.h"
+#include "IRDecoder.h"
+#include "Arena.h"
+#include "Trace.h"
+#include "Backends/Backend.h"
 
-#include <unordered_map>
 #include <array>
+#include <functional>
+
+#include <ostream>
+#include <span>
 
 namespace arcvm {
 
-struct IRLocation {
-    Block* block;
-    size_t basicblock_index;
+struct Frame {
+    BytecodeFunction const* function;
+    i32 pc;
+    i32 dest;       // register in the caller that receives the return value
+    size_t base;    // start of this frame's registers in the register stack
+    Arena::Mark stack_mark; // everything this frame allocs lives above this mark
+    i32 memo_slot = -1;     // memo table entry that gets this frame's result, if any
+    // a tail call never releases below tail_mark, memory above activation_mark is what the
+    // function that has the frame now allocated. shares_memory is set when that function's
+    // arguments can point above tail_mark, see IRInterpreter::release_tail_call_memory
+    Arena::Mark tail_mark = stack_mark;
+    Arena::Mark activation_mark = stack_mark;
+    bool shares_memory = false;
+};
+
+// how hot a function has to get before it is handed to the compiler
+// a loop only makes its function hot for the next call, running frames always finish in the interpreter
+// backedges are the br_back ops the decoder puts on every branch that closes a loop
+//
+// x86_64_Backend can't lower branches, calls or parameters yet, so with Arcvm::tiered
+// a function with a loop is declined when its backedges get hot and stays interpreted.
+// the backedge counter only pays off with a compiler that handles loops
+struct TierPolicy {
+    u32 call_threshold = 1000;
+    u32 backedge_threshold = 10000;
 };
 
+// returns nullptr for functions it can't compile, those stay in the interpreter for good
+// it gets the decoded function, whoever owns the IR finds the Function by its name
+using TierCompiler = std::function<NativeFunction(BytecodeFunction const&)>;
+
+// everything that changes while running lives in the interpreter, the FrozenModule is only read
+// so one interpreter per thread can run the same module without any locking
 class IRInterpreter {
   public:
     IRInterpreter(Module*);
+    IRInterpreter(std::vector<Module*>);
+    IRInterpreter(FrozenModule);
+    ~IRInterpreter();
 
     i32 run();
 
-    void build_jump_table(Module*);
     i32 run_module(Module*);
+    i32 run_modules(std::vector<Module*> const&);
     i32 run_entry_function();
-    IRValue run_function(Function*, std::vector<IRValue>);
-    IRValue run_block(Block*);
-    IRValue run_basicblock(BasicBlock*);
-    IRValue run_entry(Entry*);
+    IRValue run_function(i32, std::span<IRValue const>);
+    IRValue run_frames(size_t);
+
+    // most frequent first, only counted when built with ARCVM_COUNT_OP_PAIRS
+    void print_op_pairs(size_t);
+
+    // every function starts out interpreted, hot ones are compiled and called natively from then on
+    void enable_tiering(TierPolicy, TierCompiler);
+
+    // calls to pure functions look their arguments up in a table of at most entries results first
+    // a result replaces whatever was in its slot, so the table never grows
+    void enable_memoization(size_t entries = 4096);
+
+    // records the last ops that ran into a ring buffer of records entries, 0 turns it off again
+    // only recorded when built with ARCVM_TRACE
+    void enable_tracing(size_t records = 64 * 1024);
+    // oldest first, one op per line as function, block, instruction index, opcode and result
+    void dump_trace(std::ostream&);
+    // a failed assert on a thread that is running a tracing interpreter dumps its trace to stderr
+    static void dump_trace_on_abort();
+
+    // bytes held for alloc, the most the frames of every run so far needed at once
+    size_t stack_memory_reserved() const { return stack_memory.reserved(); }
+
+    // modules decoded by the interpreter itself are decoded with profiling on
+    void set_profiling(bool);
+    // counts from the last run as json keyed by function name and block label
+    // the module has to have been decoded with profiling on
+    void dump_profile(std::ostream&);
 
   private:
-    Module* module_;
-    std::unordered_map<std::string, BasicBlock*> jump_table;
-    std::unordered_map<std::string, Function*> function_table;
-    std::vector<std::string> predecessor_stack;
-    std::string current_block_name;
-    std::string entrypoint_name;
+    std::vector<Module*> modules_;
+    FrozenModule bytecode_;
+
+    std::vector<Frame> call_stack;
+
+    // every frame is a window of exactly register_count values into one stack
+    // that only ever grows, so calls don't allocate or clear anything
+    // slots are raw words, pointers are stored as their address and nothing records which is which
+    std::vector<i64> register_stack;
+    size_t register_top = 0;
+    i64* registers = nullptr;
+    // arguments of a tail call or a call to native code, reused so those don't allocate
+    std::vector<i64> tail_args;
+
+    // backs alloc, a frame's allocations are all released at once when it returns
+    // or when it tail calls and nothing can point into them anymore
+    Arena stack_memory;
+
+    struct FunctionTier {
+        u32 calls = 0;
+        u32 backedges = 0;
+        NativeFunction native = nullptr;
+        bool failed = false;
+    };
+
+    bool tiering = false;
+    TierPolicy tier_policy;
+    TierCompiler tier_compiler;
+    // indexed like BytecodeModule::functions
+    std::vector<FunctionTier> tiers;
+
+    // functions with more parameters than this are never memoized
+    static constexpr i32 memo_max_args = 4;
+
+    struct MemoEntry {
+        BytecodeFunction const* function = nullptr;
+        std::array<i64, memo_max_args> args{};
+        i64 result = 0;
+        bool valid = false;     // false while the call that claimed the slot is still running
+    };
+
+    // empty unless memoization is on, the size is a power of two
+    std::vector<MemoEntry> memo_table;
+
+    bool tracing = false;
+    TraceBuffer trace;
+
+    bool profiling = false;
+    // indexed like BytecodeModule::profile_points
+    std::vector<u64> profile_counts;
+
+    // indexed by first * opcode_count + second
+    std::vector<u64> op_pair_counts;
+    OpCode previous_opcode = OpCode::ret;
+
+    size_t push_registers(BytecodeFunction const*);
+    void release_tail_call_memory(BytecodeFunction const*);
 
-    std::vector<std::array<IRValue, 100>> ir_register;
+    FunctionTier& tier_of(BytecodeFunction const*);
+    void tier_up(FunctionTier&, BytecodeFunction const*);
+    void count_backedge(BytecodeFunction const*);
+    bool memo_lookup(BytecodeFunction const*, Operand const*, i32, i64&, i32&);
 
-    i64 unpack(IRValue);
+    // fills buffer with one line of dump_trace without allocating, returns its length
+    size_t format_trace_record(TraceRecord const&, char* buffer, size_t size) const;
 
-    inline std::string predecessor() {
-        return predecessor_stack.back();
+    inline void trace_op(BytecodeFunction const* function, Op const* code, i64 result) {
+        auto instruction = (i32)(code - function->code.data());
+        trace.push((i32)(function - bytecode_->functions.data()), function->op_blocks[instruction], instruction, result);
     }
 
-    inline void add_predecessor(std::string name) {
-        predecessor_stack.push_back(std::move(name));
+    inline void count_op_pair(OpCode opcode) {
+        ++op_pair_counts[(size_t)previous_opcode * opcode_count + (size_t)opcode];
+        previous_opcode = opcode;
     }
 
-    inline void remove_predecessor() {
-        if(!predecessor_stack.empty())
-            predecessor_stack.pop_back();
+    inline i64& reg(i64 slot) {
+        return registers[slot];
     }
 };
 
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -16,7 +16,7 @@ void print(std::vector<Attribute>&, i32 indent = 0);
 void print(Block*, i32&, i32 indent = 0);
 void print(BasicBlock*, i32&, i32 indent = 0);
 void print(Entry*, i32&, i32 indent = 0);
-void print(IRValue* value, i32 indent = 0);
+void print(IRValue const* value, i32 indent = 0);
 
 } // namespace IRPrinter
 
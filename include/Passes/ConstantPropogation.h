@@ -3,19 +3,16 @@
 #ifndef ARCVM_CONSTANT_PROPOGATION_H
 #define ARCVM_CONSTANT_PROPOGATION_H
 
-// constant folding and propogation
-
-// TODO get rid of the weird *.value.value pattern
+// constant folding and propogation across a whole function, constants reach their uses
+// through the def-use chains
 
 #include "Pass.h"
 #include "Common.h"
+#include "TypedOps.h"
 
-namespace arcvm {
+#include <optional>
 
-    struct WrappedIRValue {
-        IRValue value;
-        bool    is_constant = false;
-    };
+namespace arcvm {
 
     class ConstantPropogation {
         public:
@@ -27,24 +24,12 @@ namespace arcvm {
             void process_function(Function*);
             void process_block(Block*);
 
-            void propogate_constants(BasicBlock*);
-
-            bool isConstant(WrappedIRValue value) {
-                return value.is_constant;
-            }
+            // the value entry always computes, if its arguments make that known
+            std::optional<i64> fold(Entry*);
 
             bool isImmediate(IRValue value) {
                 return value.type == IRValueType::immediate;
             }
-
-            bool isReference(IRValue value) {
-                return value.type == IRValueType::reference;
-            }
-
-            // TODO remove *.value.value pattern
-            bool isValidValue(WrappedIRValue value) {
-                return value.value.type != IRValueType::none;
-            }
     };
 
 };
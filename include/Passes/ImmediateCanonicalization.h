@@ -7,6 +7,7 @@
 
 #include "Pass.h"
 #include "Common.h"
+#include "TypedOps.h"
 
 namespace arcvm {
 
@@ -10,21 +10,26 @@ template <Pass... Passes>
 class PassManager {
   public:
     void module_pass(Module* module) {
+        // the first pass gets settled blocks too
+        module->compact();
         run_pass<Passes...>(module);
     }
 
   private:
 
-        template <Pass P>
+    // every pass sees the blocks with its predecessor's removals and insertions settled
+    template <Pass P>
     void run_pass(Module* module) {
         P pass;
         pass.module_pass(module);
+        module->compact();
     }
 
     template <Pass P, Pass P2, Pass... Ps>
     void run_pass(Module* module) {
         P pass;
         pass.module_pass(module);
+        module->compact();
         run_pass<P2, Ps...>(module);
     }
 };
@@ -0,0 +1,28 @@
+#ifndef ARCVM_PURITY_ANALYSIS_H
+#define ARCVM_PURITY_ANALYSIS_H
+
+// marks functions whose result only depends on their arguments with Attribute::pure
+//
+// a pure function only touches memory it allocated itself and only calls other pure functions,
+// calls into other modules can't be seen from here so they make the caller impure
+
+#include "Pass.h"
+#include "Common.h"
+
+#include <vector>
+
+namespace arcvm {
+
+class PurityAnalysis {
+  public:
+    void module_pass(Module* module);
+
+  private:
+    bool is_candidate(Function*);
+    // callees is indexed by Symbol::id
+    bool calls_only(Function*, std::vector<bool> const&);
+};
+
+};
+
+#endif //ARCVM_PURITY_ANALYSIS_H
@@ -0,0 +1,152 @@
+#ifndef ARCVM_SMALL_VECTOR_H
+#define ARCVM_SMALL_VECTOR_H
+
+// vector that keeps its first N elements inside itself and only allocates past that
+//
+// made for Entry::arguments, where nearly every instruction has a handful of operands
+// and only long calls and phis spill to the heap
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace arcvm {
+
+template <typename T, size_t N>
+class SmallVector {
+  public:
+    SmallVector() = default;
+
+    SmallVector(std::initializer_list<T> values) { append(values.begin(), values.end()); }
+    SmallVector(std::vector<T> const& values) { append(values.begin(), values.end()); }
+
+    SmallVector(SmallVector const& other) { append(other.begin(), other.end()); }
+
+    SmallVector(SmallVector&& other) noexcept { take(std::move(other)); }
+
+    SmallVector& operator=(SmallVector const& other) {
+        if(this != &other) {
+            clear();
+            append(other.begin(), other.end());
+        }
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& other) noexcept {
+        if(this != &other) {
+            clear();
+            release();
+            take(std::move(other));
+        }
+        return *this;
+    }
+
+    ~SmallVector() {
+        clear();
+        release();
+    }
+
+    T* begin() { return data_; }
+    T* end() { return data_ + size_; }
+    T const* begin() const { return data_; }
+    T const* end() const { return data_ + size_; }
+
+    T* data() { return data_; }
+    T const* data() const { return data_; }
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+    // false until it has spilled to the heap
+    bool is_spilled() const { return data_ != inline_data(); }
+
+    T& operator[](size_t index) { return data_[index]; }
+    T const& operator[](size_t index) const { return data_[index]; }
+    T& front() { return data_[0]; }
+    T const& front() const { return data_[0]; }
+    T& back() { return data_[size_ - 1]; }
+    T const& back() const { return data_[size_ - 1]; }
+
+    void push_back(T value) {
+        if(size_ == capacity_)
+            grow(capacity_ * 2);
+        new(data_ + size_) T(std::move(value));
+        ++size_;
+    }
+
+    void pop_back() {
+        --size_;
+        std::destroy_at(data_ + size_);
+    }
+
+    T* erase(T* position) {
+        std::move(position + 1, end(), position);
+        pop_back();
+        return position;
+    }
+
+    void clear() {
+        std::destroy_n(data_, size_);
+        size_ = 0;
+    }
+
+  private:
+    alignas(T) std::byte storage[sizeof(T) * N];
+    T* data_ = inline_data();
+    std::uint32_t size_ = 0;
+    std::uint32_t capacity_ = N;
+
+    T* inline_data() { return reinterpret_cast<T*>(storage); }
+    T const* inline_data() const { return reinterpret_cast<T const*>(storage); }
+
+    template <typename It>
+    void append(It first, It last) {
+        auto count = (size_t)std::distance(first, last);
+        if(size_ + count > capacity_)
+            grow(std::max<size_t>(size_ + count, capacity_ * 2));
+        std::uninitialized_copy(first, last, data_ + size_);
+        size_ += (std::uint32_t)count;
+    }
+
+    void grow(size_t new_capacity) {
+        auto* new_data = static_cast<T*>(::operator new(sizeof(T) * new_capacity, std::align_val_t{alignof(T)}));
+        std::uninitialized_move(data_, data_ + size_, new_data);
+        std::destroy_n(data_, size_);
+        release();
+        data_ = new_data;
+        capacity_ = (std::uint32_t)new_capacity;
+    }
+
+    // frees the heap buffer, the elements have to be destroyed already
+    void release() {
+        if(is_spilled())
+            ::operator delete(data_, std::align_val_t{alignof(T)});
+        data_ = inline_data();
+        capacity_ = N;
+    }
+
+    // steals other's heap buffer or moves its inline elements over, other is left empty
+    void take(SmallVector&& other) {
+        if(other.is_spilled()) {
+            data_ = other.data_;
+            size_ = other.size_;
+            capacity_ = other.capacity_;
+            other.data_ = other.inline_data();
+            other.size_ = 0;
+            other.capacity_ = N;
+        }
+        else {
+            std::uninitialized_move(other.begin(), other.end(), data_);
+            size_ = other.size_;
+            other.clear();
+        }
+    }
+};
+
+};
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef ARCVM_SUPERINSTRUCTIONS_H
+#define ARCVM_SUPERINSTRUCTIONS_H
+
+// peephole pass over decoded bytecode that replaces common runs of ops with one fused op
+//
+// the patterns live in a table in Superinstructions.cpp, build with ARCVM_COUNT_OP_PAIRS
+// to see which adjacent opcodes show up the most when picking new ones
+
+#include "Common.h"
+#include "IRDecoder.h"
+
+namespace arcvm {
+
+void fuse_superinstructions(BytecodeFunction&);
+
+};
+
+#endif
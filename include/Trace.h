@@ -0,0 +1,59 @@
+#ifndef ARCVM_TRACE_H
+#define ARCVM_TRACE_H
+
+// fixed size ring buffer of the last ops an interpreter ran
+//
+// every interpreter owns its own buffer and is the only one writing to it, so recording
+// is a plain store with no locks or atomics, read it from the same thread or once it is done running
+
+#include "Common.h"
+
+#include <algorithm>
+
+namespace arcvm {
+
+struct TraceRecord {
+    i32 function;       // index into BytecodeModule::functions
+    i32 block;          // BasicBlock::id the op was decoded from, see BytecodeFunction::op_blocks
+    i32 instruction;    // index of the op in BytecodeFunction::code
+    i64 result;         // what the op wrote to its dest, the value for ret, 0 for everything else
+};
+
+class TraceBuffer {
+  public:
+    TraceBuffer() = default;
+
+    // capacity is rounded up to a power of two, 0 records nothing
+    explicit TraceBuffer(size_t capacity) {
+        size_t size = 1;
+        while(size < capacity)
+            size *= 2;
+        records.resize(capacity ? size : 0);
+        mask = records.empty() ? 0 : records.size() - 1;
+    }
+
+    inline void push(i32 function, i32 block, i32 instruction, i64 result) {
+        records[next++ & mask] = TraceRecord{function, block, instruction, result};
+    }
+
+    size_t size() const { return std::min<size_t>(next, records.size()); }
+    bool empty() const { return size() == 0; }
+
+    // oldest first
+    template <typename F>
+    void for_each(F&& f) const {
+        for(auto i = next - size(); i < next; ++i)
+            f(records[i & mask]);
+    }
+
+    void clear() { next = 0; }
+
+  private:
+    std::vector<TraceRecord> records;
+    size_t mask = 0;
+    u64 next = 0;
+};
+
+};
+
+#endif
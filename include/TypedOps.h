@@ -0,0 +1,119 @@
+#ifndef ARCVM_TYPED_OPS_H
+#define ARCVM_TYPED_OPS_H
+
+// arithmetic shared by the interpreter and the folding passes so they can't disagree
+//
+// operands are always i64, the operation happens in i64 and the result is
+// truncated to the instruction's type, untyped instructions are i64
+
+#include "Common.h"
+
+#include <concepts>
+
+namespace arcvm {
+
+// the integral types a result can be truncated to, b1 and b8 behave like i8
+#define ARCVM_INTEGRAL_TYPES(X, name) \
+    X(name, i8)                       \
+    X(name, u8)                       \
+    X(name, i16)                      \
+    X(name, u16)                      \
+    X(name, i32)                      \
+    X(name, u32)                      \
+    X(name, i64)                      \
+    X(name, u64)
+
+constexpr i32 integral_type_count = 8;
+
+// position of a type in ARCVM_INTEGRAL_TYPES
+inline i32 integral_type_index(Type type) {
+    switch(type) {
+        case Type::ir_b1:
+        case Type::ir_b8:
+        case Type::ir_i8:
+            return 0;
+        case Type::ir_u8:
+            return 1;
+        case Type::ir_i16:
+            return 2;
+        case Type::ir_u16:
+            return 3;
+        case Type::ir_i32:
+            return 4;
+        case Type::ir_u32:
+            return 5;
+        case Type::none:
+        case Type::ir_i64:
+            return 6;
+        case Type::ir_u64:
+            return 7;
+        default:
+            assert(false);
+            return 6;
+    }
+}
+
+// position of a binary operation in ARCVM_BIN_OPS
+inline i32 bin_op_index(Instruction instruction) {
+    return (i32)instruction - (i32)Instruction::add;
+}
+
+template <Instruction I>
+constexpr i64 bin_op(i64 lhs, i64 rhs) {
+    if constexpr (I == Instruction::add)
+        return lhs + rhs;
+    else if constexpr (I == Instruction::sub)
+        return lhs - rhs;
+    else if constexpr (I == Instruction::mul)
+        return lhs * rhs;
+    else if constexpr (I == Instruction::div)
+        return lhs / rhs;
+    else if constexpr (I == Instruction::mod)
+        return lhs % rhs;
+    else if constexpr (I == Instruction::bin_or)
+        return lhs | rhs;
+    else if constexpr (I == Instruction::bin_and)
+        return lhs & rhs;
+    else if constexpr (I == Instruction::bin_xor)
+        return lhs ^ rhs;
+    else if constexpr (I == Instruction::lshift)
+        return lhs << rhs;
+    else if constexpr (I == Instruction::rshift)
+        return lhs >> rhs;
+    else if constexpr (I == Instruction::lt)
+        return lhs < rhs;
+    else if constexpr (I == Instruction::gt)
+        return lhs > rhs;
+    else if constexpr (I == Instruction::lte)
+        return lhs <= rhs;
+    else if constexpr (I == Instruction::gte)
+        return lhs >= rhs;
+    else if constexpr (I == Instruction::eq)
+        return lhs == rhs;
+    else if constexpr (I == Instruction::neq)
+        return lhs != rhs;
+    else
+        static_assert(I == Instruction::add, "not a binary operation");
+}
+
+template <Instruction I, std::integral T>
+constexpr i64 typed_bin_op(i64 lhs, i64 rhs) {
+    return static_cast<T>(bin_op<I>(lhs, rhs));
+}
+
+// for callers that only know the instruction and type at run time, like the passes
+inline i64 fold_bin_op(Instruction instruction, Type type, i64 lhs, i64 rhs) {
+    using BinOpFn = i64 (*)(i64, i64);
+    static constexpr BinOpFn table[][integral_type_count] = {
+#define ARCVM_FOLD_ENTRY(name, type) &typed_bin_op<Instruction::name, type>,
+#define ARCVM_FOLD_ROW(name) {ARCVM_INTEGRAL_TYPES(ARCVM_FOLD_ENTRY, name)},
+        ARCVM_BIN_OPS(ARCVM_FOLD_ROW)
+#undef ARCVM_FOLD_ROW
+#undef ARCVM_FOLD_ENTRY
+    };
+    return table[bin_op_index(instruction)][integral_type_index(type)](lhs, rhs);
+}
+
+};
+
+#endif
@@ -25,7 +25,8 @@ void Arcvm::optimize_module(Module* module) {
     PassManager<
         CFResolutionPass,
         ImmediateCanonicalization,
-        ConstantPropogation
+        ConstantPropogation,
+        PurityAnalysis
     > pm;
     pm.module_pass(module);
 }
@@ -41,32 +42,57 @@ void Arcvm::run_canonicalization_passes() {
 }
 
 // run in interpret mode
-// TODO run all the modules in one interpreter context
-// then just return the result of the entrypoint function
+// all the modules run in one interpreter context, the result is the entrypoint function's
 i32 Arcvm::run() {
     ARCVM_PROFILE();
-    for(auto* module: modules_) {
-       IRInterpreter interp(module);
-       return interp.run();
-    }
-    return -1;
+    if(modules_.empty())
+        return -1;
+    IRInterpreter interp(modules_);
+    return interp.run();
+}
+
+FrozenModule Arcvm::freeze(bool profile) {
+    ARCVM_PROFILE();
+    for(auto* module : modules_)
+        module->compact();
+    IRDecoder decoder{profile};
+    return decoder.freeze(modules_);
 }
 
 // run in JIT mode
 i32 Arcvm::jit() {
     ARCVM_PROFILE();
-    // FIXME assume windows_x64 for now
-    x86_64_Backend b{x86_64::ABIType::windows_x64};
-    b.compile_module(modules_[0]);
+    x86_64_Backend b{x86_64::host_abi()};
+    if(!b.compile_module(modules_[0]))
+        return -1;
     return b.run();
 }
 
+// run in tiered mode
+// everything starts in the interpreter and functions that get hot are JIT compiled
+i32 Arcvm::tiered(TierPolicy policy) {
+    ARCVM_PROFILE();
+    if(modules_.empty())
+        return -1;
+    x86_64_Backend b{x86_64::host_abi()};
+    std::unordered_map<std::string_view, Function*> functions;
+    for(auto* module : modules_)
+        for(auto* function : module->functions)
+            functions.emplace(function->name, function);
+    IRInterpreter interp(modules_);
+    interp.enable_tiering(policy, [&](BytecodeFunction const& function) {
+        return b.compile_native(functions.at(function.name));
+    });
+    return interp.run();
+}
+
 // compile to binary, does not run
 i32 Arcvm::compile() {
     ARCVM_PROFILE();
     // FIXME assume windows_x64 for now
     x86_64_Backend b{x86_64::ABIType::windows_x64};
-    b.compile_module(modules_[0]);
+    if(!b.compile_module(modules_[0]))
+        return -1;
     return 0;
 }
 
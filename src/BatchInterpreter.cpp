@@ -0,0 +1,304 @@
+#include "BatchInterpreter.h"
+
+#include <algorithm>
+#include <climits>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+    #include <immintrin.h>
+#endif
+
+using namespace arcvm;
+
+namespace {
+
+using LaneKernel = void (*)(i64* dest, i64 const* lhs, i64 const* rhs, i64 const* mask);
+
+// operations on full i64 lanes that the vector kernels below cover
+template <Instruction I>
+constexpr bool has_vector_op =
+#if defined(__AVX2__) || defined(__SSE2__)
+    I == Instruction::add || I == Instruction::sub || I == Instruction::bin_and ||
+    I == Instruction::bin_or || I == Instruction::bin_xor ||
+    I == Instruction::lt || I == Instruction::gt || I == Instruction::lte ||
+    I == Instruction::gte || I == Instruction::eq || I == Instruction::neq ||
+#endif
+    false;
+
+#if defined(__AVX2__)
+using Vector = __m256i;
+
+inline Vector vector_load(i64 const* p) { return _mm256_loadu_si256((__m256i const*)p); }
+inline void vector_store(i64* p, Vector v) { _mm256_storeu_si256((__m256i*)p, v); }
+inline Vector vector_select(Vector mask, Vector a, Vector b) { return _mm256_blendv_epi8(b, a, mask); }
+
+// comparisons give all ones or zero per lane, the IR wants 1 or 0
+template <Instruction I>
+inline Vector vector_op(Vector a, Vector b) {
+    auto one = _mm256_set1_epi64x(1);
+    if constexpr (I == Instruction::add)
+        return _mm256_add_epi64(a, b);
+    else if constexpr (I == Instruction::sub)
+        return _mm256_sub_epi64(a, b);
+    else if constexpr (I == Instruction::bin_and)
+        return _mm256_and_si256(a, b);
+    else if constexpr (I == Instruction::bin_or)
+        return _mm256_or_si256(a, b);
+    else if constexpr (I == Instruction::bin_xor)
+        return _mm256_xor_si256(a, b);
+    else if constexpr (I == Instruction::lt)
+        return _mm256_and_si256(_mm256_cmpgt_epi64(b, a), one);
+    else if constexpr (I == Instruction::gt)
+        return _mm256_and_si256(_mm256_cmpgt_epi64(a, b), one);
+    else if constexpr (I == Instruction::lte)
+        return _mm256_andnot_si256(_mm256_cmpgt_epi64(a, b), one);
+    else if constexpr (I == Instruction::gte)
+        return _mm256_andnot_si256(_mm256_cmpgt_epi64(b, a), one);
+    else if constexpr (I == Instruction::eq)
+        return _mm256_and_si256(_mm256_cmpeq_epi64(a, b), one);
+    else
+        return _mm256_andnot_si256(_mm256_cmpeq_epi64(a, b), one);
+}
+#elif defined(__SSE2__)
+using Vector = __m128i;
+
+inline Vector vector_load(i64 const* p) { return _mm_loadu_si128((__m128i const*)p); }
+inline void vector_store(i64* p, Vector v) { _mm_storeu_si128((__m128i*)p, v); }
+inline Vector vector_select(Vector mask, Vector a, Vector b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// the 64 bit compares are SSE4.1 and SSE4.2, plain SSE2 builds them out of 32 bit halves
+inline Vector vector_cmpeq(Vector a, Vector b) {
+#if defined(__SSE4_1__)
+    return _mm_cmpeq_epi64(a, b);
+#else
+    // equal when both halves are, swap the halves of every lane and combine
+    auto halves = _mm_cmpeq_epi32(a, b);
+    return _mm_and_si128(halves, _mm_shuffle_epi32(halves, _MM_SHUFFLE(2, 3, 0, 1)));
+#endif
+}
+
+inline Vector vector_cmpgt(Vector a, Vector b) {
+#if defined(__SSE4_2__)
+    return _mm_cmpgt_epi64(a, b);
+#else
+    // the signed high halves decide unless they are equal, then the low halves do unsigned
+    // flipping the sign bit turns the signed 32 bit compare into an unsigned one
+    auto sign = _mm_set1_epi32(INT_MIN);
+    auto high_gt = _mm_cmpgt_epi32(a, b);
+    auto high_eq = _mm_cmpeq_epi32(a, b);
+    auto low_gt = _mm_cmpgt_epi32(_mm_xor_si128(a, sign), _mm_xor_si128(b, sign));
+    auto gt = _mm_or_si128(high_gt, _mm_and_si128(high_eq, _mm_shuffle_epi32(low_gt, _MM_SHUFFLE(2, 2, 0, 0))));
+    return _mm_shuffle_epi32(gt, _MM_SHUFFLE(3, 3, 1, 1));
+#endif
+}
+
+// comparisons give all ones or zero per lane, the IR wants 1 or 0
+template <Instruction I>
+inline Vector vector_op(Vector a, Vector b) {
+    auto one = _mm_set1_epi64x(1);
+    if constexpr (I == Instruction::add)
+        return _mm_add_epi64(a, b);
+    else if constexpr (I == Instruction::sub)
+        return _mm_sub_epi64(a, b);
+    else if constexpr (I == Instruction::bin_and)
+        return _mm_and_si128(a, b);
+    else if constexpr (I == Instruction::bin_or)
+        return _mm_or_si128(a, b);
+    else if constexpr (I == Instruction::bin_xor)
+        return _mm_xor_si128(a, b);
+    else if constexpr (I == Instruction::lt)
+        return _mm_and_si128(vector_cmpgt(b, a), one);
+    else if constexpr (I == Instruction::gt)
+        return _mm_and_si128(vector_cmpgt(a, b), one);
+    else if constexpr (I == Instruction::lte)
+        return _mm_andnot_si128(vector_cmpgt(a, b), one);
+    else if constexpr (I == Instruction::gte)
+        return _mm_andnot_si128(vector_cmpgt(b, a), one);
+    else if constexpr (I == Instruction::eq)
+        return _mm_and_si128(vector_cmpeq(a, b), one);
+    else
+        return _mm_andnot_si128(vector_cmpeq(a, b), one);
+}
+#endif
+
+// masked off lanes keep what they had, they may still read it after the lanes line up again
+// i64 and u64 results aren't truncated so those can use the vector kernels,
+// everything else is a plain loop the compiler is free to vectorize on its own
+// the loop gives masked off lanes zero operands, stale ones could overflow or shift too far
+template <Instruction I, std::integral T>
+void lane_kernel(i64* dest, i64 const* lhs, i64 const* rhs, i64 const* mask) {
+    constexpr i32 lanes = BatchInterpreter::lanes;
+    if constexpr (I == Instruction::div || I == Instruction::mod) {
+        // a masked off lane can be holding a zero divisor
+        for(i32 l = 0; l < lanes; ++l)
+            if(mask[l])
+                dest[l] = typed_bin_op<I, T>(lhs[l], rhs[l]);
+        return;
+    }
+    i32 l = 0;
+#if defined(__AVX2__) || defined(__SSE2__)
+    if constexpr (has_vector_op<I> && sizeof(T) == 8) {
+        constexpr i32 width = sizeof(Vector) / sizeof(i64);
+        for(; l + width <= lanes; l += width) {
+            auto result = vector_op<I>(vector_load(lhs + l), vector_load(rhs + l));
+            vector_store(dest + l, vector_select(vector_load(mask + l), result, vector_load(dest + l)));
+        }
+    }
+#endif
+    for(; l < lanes; ++l)
+        dest[l] = (typed_bin_op<I, T>(lhs[l] & mask[l], rhs[l] & mask[l]) & mask[l]) | (dest[l] & ~mask[l]);
+}
+
+// same layout as the typed opcodes, indexed by their distance from add_i8
+constexpr LaneKernel lane_kernels[] = {
+#define ARCVM_LANE_KERNEL(name, type) &lane_kernel<Instruction::name, type>,
+#define ARCVM_LANE_KERNELS(name) ARCVM_INTEGRAL_TYPES(ARCVM_LANE_KERNEL, name)
+    ARCVM_BIN_OPS(ARCVM_LANE_KERNELS)
+#undef ARCVM_LANE_KERNELS
+#undef ARCVM_LANE_KERNEL
+};
+
+}
+
+BatchInterpreter::BatchInterpreter(FrozenModule bytecode)
+    : bytecode_{bytecode}, fallback{bytecode}, registers{}, groups{}, mask(lanes), taken(lanes) {}
+
+bool BatchInterpreter::can_batch(BytecodeFunction const& function) {
+    for(auto const& op : function.code) {
+        if(is_typed_bin_op(op.opcode) || is_branch(op.opcode))
+            continue;
+        switch(op.opcode) {
+            case OpCode::dup:
+            case OpCode::neg:
+            case OpCode::ret:
+                continue;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+void BatchInterpreter::run_function(i32 index, std::span<i64 const> args, std::span<i64> results) {
+    ARCVM_PROFILE();
+    auto const& function = bytecode_->functions[index];
+    auto param_count = (size_t)function.parameter_count;
+    assert(args.size() == results.size() * param_count);
+
+    if(!can_batch(function)) {
+        std::vector<IRValue> values(param_count);
+        for(size_t i = 0; i < results.size(); ++i) {
+            for(size_t p = 0; p < param_count; ++p)
+                values[p] = IRValue{args[i * param_count + p]};
+            auto result = fallback.run_function(index, values);
+            results[i] = result.type == IRValueType::none ? 0 : result.value;
+        }
+        return;
+    }
+
+    registers.resize((size_t)function.register_count * lanes);
+    for(size_t first = 0; first < results.size(); first += lanes) {
+        auto count = (i32)std::min<size_t>(lanes, results.size() - first);
+        run_lanes(function, args.data() + first * param_count, results.data() + first, count);
+    }
+}
+
+// groups are sorted by pc, lanes that land on a block some group is already waiting at join it
+void BatchInterpreter::add_lanes(i32 pc, u64 members) {
+    if(!members)
+        return;
+    auto it = groups.begin();
+    while(it != groups.end() && it->pc > pc)
+        ++it;
+    if(it != groups.end() && it->pc == pc)
+        it->members |= members;
+    else
+        groups.insert(it, LaneGroup{pc, members});
+}
+
+// lanes past count have no input and never run
+// lanes only split at the branch that ends a block, so the mask is built once per block that runs
+void BatchInterpreter::run_lanes(BytecodeFunction const& function, i64 const* args, i64* results, i32 count) {
+    static_assert(lanes <= 64, "a LaneGroup holds one bit per lane");
+    auto param_count = function.parameter_count;
+    for(i32 p = 0; p < param_count; ++p)
+        for(i32 l = 0; l < count; ++l)
+            reg(p)[l] = args[l * param_count + p];
+    for(size_t c = 0; c < function.constants.size(); ++c)
+        std::fill_n(reg(function.constant_base + (i64)c), lanes, function.constants[c]);
+    groups.clear();
+    add_lanes(0, count == 64 ? ~0ull : (1ull << count) - 1);
+
+    while(!groups.empty()) {
+        auto [pc, members] = groups.back();
+        groups.pop_back();
+        for(i32 l = 0; l < lanes; ++l)
+            mask[l] = (members >> l) & 1 ? -1 : 0;
+
+        for(;; ++pc) {
+            auto const& op = function.code[pc];
+            if(is_typed_bin_op(op.opcode)) {
+                auto kernel = lane_kernels[(size_t)op.opcode - (size_t)OpCode::add_i8];
+                kernel(reg(op.dest), reg(op.a), reg(op.b), mask.data());
+                continue;
+            }
+            if(op.opcode >= OpCode::br_lt && op.opcode <= OpCode::br_neq) {
+                // the comparison is i64 so it can go through the i64 kernel into taken
+                auto instruction = static_cast<Instruction>((i32)Instruction::lt + (i32)op.opcode - (i32)OpCode::br_lt);
+                lane_kernels[(size_t)typed_opcode(instruction, Type::ir_i64) - (size_t)OpCode::add_i8](
+                    taken.data(), reg(op.a), reg(op.b), mask.data());
+                u64 taken_members = 0;
+                for(i32 l = 0; l < lanes; ++l)
+                    taken_members |= (u64)(taken[l] != 0) << l;
+                taken_members &= members;
+                add_lanes(op.x, taken_members);
+                add_lanes(op.y, members & ~taken_members);
+                break;
+            }
+            switch(op.opcode) {
+                case OpCode::dup: {
+                    auto* dest = reg(op.dest);
+                    auto* src = reg(op.a);
+                    for(i32 l = 0; l < lanes; ++l)
+                        dest[l] = (src[l] & mask[l]) | (dest[l] & ~mask[l]);
+                    continue;
+                }
+                case OpCode::neg: {
+                    auto* dest = reg(op.dest);
+                    auto* src = reg(op.a);
+                    for(i32 l = 0; l < lanes; ++l)
+                        dest[l] = (-src[l] & mask[l]) | (dest[l] & ~mask[l]);
+                    continue;
+                }
+                case OpCode::br:
+                case OpCode::br_back:
+                    add_lanes(op.x, members);
+                    break;
+                case OpCode::brz:
+                case OpCode::brnz: {
+                    auto* cond = reg(op.a);
+                    u64 zero_members = 0;
+                    for(i32 l = 0; l < lanes; ++l)
+                        zero_members |= (u64)(cond[l] == 0) << l;
+                    zero_members &= members;
+                    auto x_members = op.opcode == OpCode::brz ? zero_members : members & ~zero_members;
+                    add_lanes(op.x, x_members);
+                    add_lanes(op.y, members & ~x_members);
+                    break;
+                }
+                case OpCode::ret: {
+                    auto* value = op.a_kind == OperandKind::reg ? reg(op.a) : nullptr;
+                    for(i32 l = 0; l < count; ++l)
+                        if((members >> l) & 1)
+                            results[l] = value ? value[l] : 0;
+                    break;
+                }
+                default:
+                    assert(false);  // can_batch lets through an op that has no lane version
+                    return;
+            }
+            break;
+        }
+    }
+}
@@ -0,0 +1,428 @@
+#include "IRDecoder.h"
+#include "Superinstructions.h"
+
+using namespace arcvm;
+
+static bool is_terminator(Instruction instruction) {
+    switch(instruction) {
+        case Instruction::br:
+        case Instruction::brz:
+        case Instruction::brnz:
+        case Instruction::ret:
+            return true;
+        default:
+            return false;
+    }
+}
+
+BytecodeModule IRDecoder::decode(Module* module) {
+    return decode(std::vector<Module*>{module});
+}
+
+BytecodeModule IRDecoder::decode(std::vector<Module*> const& modules) {
+    ARCVM_PROFILE();
+    BytecodeModule bytecode;
+    // nothing carries over from an earlier decode, a new module can even sit at the address of an old one
+    function_indices.clear();
+    callee_symbols = nullptr;
+    callee_indices.clear();
+    // callees can be defined after their callers or in another module so index everything first
+    std::vector<Function*> functions;
+    for(auto* module : modules) {
+        assert(module->is_compact());   // callers compact, the decoder never writes to the IR
+        for(auto* function : module->functions) {
+            auto [it, inserted] = function_indices.emplace(function->name, (i32)functions.size());
+            assert(inserted);   // function names have to be unique across all the modules
+            for(auto attribute : function->attributes) {
+                if(attribute == Attribute::entrypoint) {
+                    assert(bytecode.entrypoint == -1);  // more than one entrypoint
+                    bytecode.entrypoint = (i32)functions.size();
+                }
+            }
+            functions.push_back(function);
+        }
+    }
+    profile_points.clear();
+    for(function_index = 0; function_index < (i32)functions.size(); ++function_index)
+        bytecode.functions.push_back(decode_function(functions[function_index]));
+    bytecode.profile_points = std::move(profile_points);
+    // the functions won't move anymore so calls can point at them directly
+    for(auto& function : bytecode.functions)
+        for(auto& op : function.code)
+            if(op.opcode == OpCode::call || op.opcode == OpCode::tail_call)
+                op.a = (i64)(uintptr_t)&bytecode.functions[op.a];
+    find_escapes(bytecode);
+    return bytecode;
+}
+
+FrozenModule IRDecoder::freeze(std::vector<Module*> const& modules) {
+    return std::make_shared<BytecodeModule const>(decode(modules));
+}
+
+BytecodeFunction IRDecoder::decode_function(Function* function) {
+    ARCVM_PROFILE();
+    BytecodeFunction result{function->name, function->value_count()};
+    result.parameter_count = (i32)function->parameters.size();
+    auto& blocks = function->block->blocks;
+    result.block_labels.resize(blocks.size());
+    for(auto* bblock : blocks) {
+        result.block_labels[bblock->id] = bblock->label.name;
+        result.block_layout.push_back(bblock->id);
+    }
+    for(auto attribute : function->attributes)
+        if(attribute == Attribute::pure)
+            result.pure = true;
+
+    // labels and callees are symbols of the function's Module, look them up by symbol id
+    // both tables are sized once per module, every function only clears the labels it set
+    auto& symbols = *function->block->symbols;
+    if(callee_symbols != &symbols) {
+        callee_symbols = &symbols;
+        block_ids.assign(symbols.size(), -1);
+        callee_indices.assign(symbols.size(), -1);
+        for(u32 id = 0; id < symbols.size(); ++id)
+            if(auto it = function_indices.find(symbols[id]->name); it != function_indices.end())
+                callee_indices[id] = it->second;
+    }
+    phis.assign(blocks.size(), {});
+    layout_positions.resize(blocks.size());
+    for(i32 i = 0; i < (i32)blocks.size(); ++i)
+        layout_positions[blocks[i]->id] = i;
+    edge_blocks.clear();
+    scratch_count = 0;
+    for(auto* bblock : blocks) {
+        assert(bblock->id >= 0 && bblock->id < (i32)blocks.size());
+        assert(bblock->columns_match());
+        block_ids[bblock->label.symbol->id] = bblock->id;
+        for(size_t i = 0; i < bblock->instructions.size(); ++i)
+            if(bblock->instructions[i] == Instruction::phi)
+                phis[bblock->id].push_back(bblock->entries()[i]);
+    }
+
+    result.block_offsets.resize(blocks.size());
+    for(auto* bblock : blocks) {
+        result.block_offsets[bblock->id] = (i32)result.code.size();
+        if(profile)
+            result.code.push_back(decode_count(ProfileKind::block, bblock->id));
+        for(auto* entry : bblock->entries()) {
+            if(entry->instruction() == Instruction::phi)
+                continue;
+            if(profile && entry->instruction() == Instruction::call) {
+                auto callee = decode_callee(entry->arguments()[0]);
+                result.code.push_back(decode_count(ProfileKind::call, bblock->id, callee));
+            }
+            result.code.push_back(decode_entry(entry, bblock->id, result));
+        }
+        // falling off the end of a block used to end the function
+        if(bblock->instructions.empty() || !is_terminator(bblock->instructions.back()))
+            result.code.push_back(Op{OpCode::ret});
+    }
+
+    // conditional branches into a block with phis go through a block of their own
+    // that holds the copies for that edge, when profiling every conditional edge does
+    for(auto [from, to, counter] : edge_blocks) {
+        result.block_offsets.push_back((i32)result.code.size());
+        if(counter != -1) {
+            Op count{OpCode::count};
+            count.x = counter;
+            result.code.push_back(count);
+        }
+        decode_edge(from, to, result);
+        Op op{is_backedge(from, to) ? OpCode::br_back : OpCode::br};
+        op.x = to;
+        result.code.push_back(op);
+    }
+
+    // branch targets are recorded as block ids until every block has an offset
+    for(auto& op : result.code) {
+        if(!is_branch(op.opcode))
+            continue;
+        op.x = result.block_offsets[op.x];
+        if(!is_unconditional_branch(op.opcode))
+            op.y = result.block_offsets[op.y];
+    }
+    result.register_count += scratch_count;
+    fuse_superinstructions(result);
+    // the superinstruction patterns match plain loads and stores, the rest get their width now
+    for(auto& op : result.code)
+        if(op.opcode == OpCode::load || op.opcode == OpCode::store)
+            op.opcode = typed_memory_opcode(op.opcode, op.type);
+    materialize_constants(result);
+
+    // blocks are laid out in the order of Block::blocks, then the edge blocks in the order they were made
+    result.op_blocks.resize(result.code.size());
+    auto laid_out = [&](i32 position) { return position < (i32)blocks.size() ? blocks[position]->id : position; };
+    for(i32 position = 0; position < (i32)result.block_offsets.size(); ++position) {
+        auto end = position + 1 < (i32)result.block_offsets.size() ? result.block_offsets[laid_out(position + 1)] : (i32)result.code.size();
+        std::fill(result.op_blocks.begin() + result.block_offsets[laid_out(position)], result.op_blocks.begin() + end, laid_out(position));
+    }
+    for(auto* bblock : blocks)
+        block_ids[bblock->label.symbol->id] = -1;
+    return result;
+}
+
+// gives every distinct immediate operand a register of its own after all the others
+// so the interpreter reads every operand from a register without checking what kind it is
+// the callee of a call and the increment of inc_mem aren't values and stay immediates
+void IRDecoder::materialize_constants(BytecodeFunction& function) {
+    ARCVM_PROFILE();
+    std::unordered_map<i64, i32> slots;
+    function.constant_base = function.register_count;
+    auto materialize = [&](OperandKind& kind, i64& value) {
+        if(kind != OperandKind::imm)
+            return;
+        auto [it, inserted] = slots.emplace(value, function.constant_base + (i32)function.constants.size());
+        if(inserted)
+            function.constants.push_back(value);
+        kind = OperandKind::reg;
+        value = it->second;
+    };
+    for(auto& op : function.code) {
+        if(op.opcode != OpCode::call && op.opcode != OpCode::tail_call)
+            materialize(op.a_kind, op.a);
+        if(!is_inc_mem(op.opcode))
+            materialize(op.b_kind, op.b);
+    }
+    for(auto& operand : function.operand_pool)
+        materialize(operand.kind, operand.value);
+    function.register_count += (i32)function.constants.size();
+}
+
+// follows every value computed from an alloc'd pointer, or from a parameter if from_parameters
+// loops can carry a value around so it runs until nothing changes
+// a call only keeps a pointer if its callee's parameters escape, so callees have to be resolved
+bool IRDecoder::escapes(BytecodeFunction const& function, bool from_parameters) {
+    ARCVM_PROFILE();
+    std::vector<bool> derived(function.register_count, false);
+    if(from_parameters)
+        std::fill(derived.begin(), derived.begin() + function.parameter_count, true);
+    auto is_derived = [&](OperandKind kind, i64 value) { return kind == OperandKind::reg && derived[value]; };
+    auto any_argument_derived = [&](Op const& op) {
+        for(i32 i = 0; i < op.y; ++i)
+            if(is_derived(function.operand_pool[op.x + i].kind, function.operand_pool[op.x + i].value))
+                return true;
+        return false;
+    };
+
+    bool changed = true;
+    while(changed) {
+        changed = false;
+        for(auto const& op : function.code) {
+            bool is_call = op.opcode == OpCode::call || op.opcode == OpCode::tail_call;
+            bool reads_derived = is_call ? any_argument_derived(op) : is_derived(op.a_kind, op.a) || is_derived(op.b_kind, op.b);
+            if(op.opcode == OpCode::call && reads_derived &&
+                reinterpret_cast<BytecodeFunction const*>((uintptr_t)op.a)->parameters_escape)
+                return true;
+            // storing a pointer is all it takes, storing into one isn't
+            bool stores = op.opcode == OpCode::store || (op.opcode >= OpCode::store_i8 && op.opcode <= OpCode::store_i64) ||
+                is_alloc_store(op.opcode) || is_load_op_store(op.opcode);
+            if(stores && is_derived(op.b_kind, op.b))
+                return true;
+            // a loaded value could only be a pointer if one was stored, and that already escaped
+            bool loads = op.opcode >= OpCode::load_i8 && op.opcode < OpCode::store_i8;
+            bool allocates = !from_parameters && (op.opcode == OpCode::alloc || is_alloc_store(op.opcode));
+            if(op.dest >= 0 && !derived[op.dest] && (allocates || (reads_derived && !loads))) {
+                derived[op.dest] = true;
+                changed = true;
+            }
+        }
+    }
+    return false;
+}
+
+// whether parameters escape depends on the callees, every function starts out with parameters
+// that don't and any that turns out to let them escape goes around again for its callers
+void IRDecoder::find_escapes(BytecodeModule& bytecode) {
+    ARCVM_PROFILE();
+    for(auto& function : bytecode.functions)
+        function.parameters_escape = false;
+    bool changed = true;
+    while(changed) {
+        changed = false;
+        for(auto& function : bytecode.functions) {
+            if(!function.parameters_escape && escapes(function, true)) {
+                function.parameters_escape = true;
+                changed = true;
+            }
+        }
+    }
+    for(auto& function : bytecode.functions)
+        function.allocations_escape = escapes(function, false);
+}
+
+Op IRDecoder::decode_entry(Entry* entry, i32 block_id, BytecodeFunction& function) {
+    Op op{to_opcode(entry->instruction())};
+    if(entry->dest().type != IRValueType::none)
+        op.dest = (i32)entry->dest().value;
+    assert(op.dest < function.register_count);
+
+    auto args = entry->arguments();
+    auto set_a = [&](IRValue value) {
+        auto operand = decode_operand(value);
+        op.a_kind = operand.kind;
+        op.a = operand.value;
+    };
+    auto set_b = [&](IRValue value) {
+        auto operand = decode_operand(value);
+        op.b_kind = operand.kind;
+        op.b = operand.value;
+    };
+
+    switch(entry->instruction()) {
+        case Instruction::alloc:
+            op.type = args[0].type_value;
+            break;
+        case Instruction::load:
+            set_a(args[0]);
+            if(args.size() > 1)
+                op.type = args[1].type_value;
+            break;
+        case Instruction::store:
+            set_a(args[0]);
+            set_b(args[1]);
+            if(args.size() > 2)
+                op.type = args[2].type_value;
+            break;
+        case Instruction::call: {
+            op.a_kind = OperandKind::imm;
+            op.a = decode_callee(args[0]);
+            // the last argument is the return type
+            auto end = args.size();
+            if(args.back().type == IRValueType::type) {
+                op.type = args.back().type_value;
+                --end;
+            }
+            op.x = (i32)function.operand_pool.size();
+            for(size_t i = 1; i < end; ++i)
+                function.operand_pool.push_back(decode_operand(args[i]));
+            op.y = (i32)(end - 1);
+            break;
+        }
+        case Instruction::ret:
+            if(!args.empty())
+                set_a(args[0]);
+            break;
+        case Instruction::br:
+            op.x = decode_label(args[0]);
+            decode_edge(block_id, op.x, function);
+            if(is_backedge(block_id, op.x))
+                op.opcode = OpCode::br_back;
+            break;
+        case Instruction::brz:
+        case Instruction::brnz:
+            set_a(args[0]);
+            op.x = decode_target(block_id, decode_label(args[1]), ProfileKind::taken);
+            op.y = decode_target(block_id, decode_label(args[2]), ProfileKind::not_taken);
+            break;
+        case Instruction::dup:
+        case Instruction::neg:
+            set_a(args[0]);
+            break;
+        case Instruction::index:
+            set_a(args[0]);
+            set_b(args[1]);
+            break;
+        default:    // binary operations
+            set_a(args[0]);
+            set_b(args[1]);
+            if(args.size() == 3)
+                op.type = args[2].type_value;
+            op.opcode = typed_opcode(entry->instruction(), op.type);
+            break;
+    }
+    return op;
+}
+
+// a conditional backedge gets an edge block too so the br_back can end it
+i32 IRDecoder::decode_target(i32 from, i32 to, ProfileKind kind) {
+    if(phis[to].empty() && !profile && !is_backedge(from, to))
+        return to;
+    auto counter = -1;
+    if(profile) {
+        counter = (i32)profile_points.size();
+        profile_points.push_back(ProfilePoint{kind, function_index, from});
+    }
+    edge_blocks.emplace_back(from, to, counter);
+    return (i32)(phis.size() + edge_blocks.size() - 1);
+}
+
+// by where the blocks are laid out, not by their ids or where their code ends up
+// edge blocks come after every real block but stand in for the edge from the block they branch from
+bool IRDecoder::is_backedge(i32 from, i32 to) const {
+    return layout_positions[to] <= layout_positions[from];
+}
+
+Op IRDecoder::decode_count(ProfileKind kind, i32 block_id, i32 callee) {
+    Op op{OpCode::count};
+    op.x = (i32)profile_points.size();
+    profile_points.push_back(ProfilePoint{kind, function_index, block_id, callee});
+    return op;
+}
+
+// phis in the target block read their incoming value for this edge as one parallel copy
+// if a copy would overwrite a value that a later one still reads, everything goes through scratch registers
+void IRDecoder::decode_edge(i32 from, i32 to, BytecodeFunction& function) {
+    std::vector<std::pair<i32, Operand>> copies;
+    for(auto* phi : phis[to]) {
+        auto args = phi->arguments();
+        assert(!(args.size() & 1));
+        for(size_t i = 0; i < args.size(); i += 2) {
+            if(decode_label(args[i]) == from) {
+                copies.emplace_back((i32)phi->dest().value, decode_operand(args[i + 1]));
+                break;
+            }
+        }
+    }
+
+    bool overlapping = false;
+    for(size_t i = 0; i < copies.size(); ++i)
+        for(size_t j = i + 1; j < copies.size(); ++j)
+            if(copies[j].second.kind == OperandKind::reg && copies[j].second.value == copies[i].first)
+                overlapping = true;
+
+    auto emit_dup = [&](i32 dest, Operand source) {
+        Op op{OpCode::dup};
+        op.dest = dest;
+        op.a_kind = source.kind;
+        op.a = source.value;
+        function.code.push_back(op);
+    };
+
+    if(!overlapping) {
+        for(auto& [dest, source] : copies)
+            emit_dup(dest, source);
+        return;
+    }
+    // register_count is still the function's value count, the scratch registers are added after every edge
+    auto scratch = function.register_count;
+    scratch_count = std::max(scratch_count, (i32)copies.size());
+    for(size_t i = 0; i < copies.size(); ++i)
+        emit_dup(scratch + (i32)i, copies[i].second);
+    for(size_t i = 0; i < copies.size(); ++i)
+        emit_dup(copies[i].first, Operand{OperandKind::reg, scratch + (i64)i});
+}
+
+Operand IRDecoder::decode_operand(IRValue value) {
+    switch(value.type) {
+        case IRValueType::reference:
+        case IRValueType::pointer:
+            return Operand{OperandKind::reg, value.value};
+        case IRValueType::immediate:
+            return Operand{OperandKind::imm, value.value};
+        default:
+            assert(false);
+            return Operand{OperandKind::none, 0};
+    }
+}
+
+i32 IRDecoder::decode_label(IRValue value) {
+    auto id = block_ids[value.symbol->id];
+    assert(id != -1);   // branch to a block outside of the function
+    return id;
+}
+
+i32 IRDecoder::decode_callee(IRValue value) {
+    auto index = callee_indices[value.symbol->id];
+    assert(index != -1);    // call to a function that was never defined
+    return index;
+}
@@ -1,19 +1,29 @@
 #include "IRGenerator.h"
 
+#include <algorithm>
+
 using namespace arcvm;
 
 IRGenerator::IRGenerator() {}
 
-// TODO use allocator
+IRGenerator::~IRGenerator() {
+    for(auto* module : modules_)
+        delete module;
+}
+
 Module* IRGenerator::create_module() {
-    return new Module{};
+    modules_.push_back(new Module{});
+    return modules_.back();
 }
 
-// TODO use allocator
 Function* Module::gen_function_def(std::string name, std::vector<Type> parameters, Type return_type) {
     ARCVM_PROFILE();
-    auto* func = new Function{name, std::move(parameters), return_type, {}};
-    auto* block = func->get_block();
+    auto* func = arena.make<Function>(name, std::move(parameters), return_type);
+    auto* block = arena.make<Block>();
+    block->var_name = (i32)func->parameters.size();
+    block->arena = &arena;
+    block->symbols = &symbols;
+    func->block = block;
     block->new_basic_block(name);
     functions.push_back(func);
     return functions.back();
@@ -21,22 +31,68 @@ Function* Module::gen_function_def(std::string name, std::vector<Type> parameter
 
 // Function* gen_aggregate_def(std::string, std::vector<Type>);
 
-void Block::set_insertion_point(BasicBlock* bb) {
+void Module::compact() {
     ARCVM_PROFILE();
-    for(i32 i = 0; i < blocks.size(); ++i)
-        if(blocks[i] == bb)
-            insertion_point = i;
+    for(auto* function : functions)
+        function->block->compact();
+}
+
+bool Module::is_compact() const {
+    for(auto* function : functions)
+        if(!function->block->is_compact())
+            return false;
+    return true;
+}
+
+bool Block::is_compact() const {
+    if(!pending_blocks.empty())
+        return false;
+    for(auto* bblock : blocks)
+        if(!bblock->is_compact())
+            return false;
+    return true;
+}
+
+// a pending block goes right after the block it was made after, in front of any made there before it
+// so every block is followed by the ones made after it, newest first, each followed by its own the same way
+void Block::compact() {
+    ARCVM_PROFILE();
+    if(!pending_blocks.empty()) {
+        std::vector<std::vector<BasicBlock*>> followers(block_count);
+        for(auto [bblock, after] : pending_blocks)
+            followers[after->id].push_back(bblock);
+        std::vector<BasicBlock*> stack(blocks.rbegin(), blocks.rend());
+        blocks.clear();
+        while(!stack.empty()) {
+            auto* bblock = stack.back();
+            stack.pop_back();
+            blocks.push_back(bblock);
+            stack.insert(stack.end(), followers[bblock->id].begin(), followers[bblock->id].end());
+        }
+        pending_blocks.clear();
+    }
+    for(auto* bblock : blocks)
+        bblock->compact();
+}
+
+void Block::set_insertion_point(BasicBlock* bb) {
+    insertion_point = bb;
 }
 
 void Block::set_insertion_point(std::string label) {
     ARCVM_PROFILE();
-    for(i32 i = 0; i < blocks.size(); ++i)
-        if(blocks[i]->label.name == label)
-            insertion_point = i;
+    auto* symbol = symbols->find(label);
+    for(auto* bblock : blocks)
+        if(bblock->label.symbol == symbol)
+            insertion_point = bblock;
+    for(auto [bblock, after] : pending_blocks)
+        if(bblock->label.symbol == symbol)
+            insertion_point = bblock;
 }
 
 void Block::set_insertion_point(i32 new_point) {
-    insertion_point = new_point;
+    compact();
+    insertion_point = blocks[new_point];
 }
 
 BasicBlock* Block::new_basic_block() {
@@ -46,15 +102,16 @@ BasicBlock* Block::new_basic_block() {
     return new_block;
 }
 
-// TODO use allocator
 BasicBlock* Block::new_basic_block(std::string label_name) {
     ARCVM_PROFILE();
-    auto* new_block = new BasicBlock(std::move(label_name), std::vector<Entry*>{}, var_name);
-    ++insertion_point;
-    if(blocks.empty())
+    auto* new_block = arena->make<BasicBlock>(symbols->intern(label_name), std::vector<Entry*>{}, var_name, values, *arena, *symbols);
+    new_block->id = block_count++;
+    // going after the last block is the usual case, anywhere else compact() finds its place
+    if(!insertion_point || (pending_blocks.empty() && insertion_point == blocks.back()))
         blocks.push_back(new_block);
     else
-        blocks.insert(blocks.cbegin() + insertion_point, new_block);
+        pending_blocks.emplace_back(new_block, insertion_point);
+    insertion_point = new_block;
     return new_block;
 }
 
@@ -62,29 +119,236 @@ BasicBlock* Block::new_basic_block(std::string label_name) {
 // this generates the final jump out of the block
 void Block::gen_if(IRValue cond, BasicBlock* if_block, BasicBlock* else_block, BasicBlock* then_block) {
     ARCVM_PROFILE();
-    auto* bblock = blocks[insertion_point];
-    auto if_block_name = IRValue{IRValueType::label, new std::string(if_block->label.name)};
-    auto else_block_name = IRValue{IRValueType::label, new std::string(else_block->label.name)};
+    auto* bblock = insertion_point;
+    auto if_block_name = if_block->label_value();
+    auto else_block_name = else_block->label_value();
     bblock->gen_inst(Instruction::brnz, {cond,if_block_name,else_block_name});
-    auto then_block_name = IRValue{IRValueType::label, new std::string(then_block->label.name)};
+    auto then_block_name = then_block->label_value();
     if_block->gen_inst(Instruction::br, {then_block_name});
     else_block->gen_inst(Instruction::br, {then_block_name});
 }
 
+static ValueInfo& value_info(std::vector<ValueInfo>& values, i64 value) {
+    if(value >= (i64)values.size())
+        values.resize(value + 1);
+    return values[value];
+}
+
+static void link_use(std::vector<ValueInfo>& values, Use* use) {
+    auto& info = value_info(values, use->user->arguments()[use->operand].value);
+    use->prev = nullptr;
+    use->next = info.uses;
+    if(info.uses)
+        info.uses->prev = use;
+    info.uses = use;
+}
+
+// has to happen before the argument changes, the value it reads says which list the use is in
+static void unlink_use(std::vector<ValueInfo>& values, Use* use) {
+    if(use->prev)
+        use->prev->next = use->next;
+    else
+        values[use->user->arguments()[use->operand].value].uses = use->next;
+    if(use->next)
+        use->next->prev = use->prev;
+    use->prev = use->next = nullptr;
+}
+
+ValueInfo& Block::value_info(i64 value) {
+    return ::value_info(values, value);
+}
+
+void Block::set_argument(Entry* entry, u32 operand, IRValue value) {
+    // BasicBlock::types holds the explicit type, it would go stale
+    assert(entry->arguments_[operand].type != IRValueType::type && value.type != IRValueType::type);
+    auto* use = &entry->uses_[operand];
+    if(is_value(entry->arguments_[operand]))
+        unlink_use(values, use);
+    entry->arguments_[operand] = value;
+    if(is_value(value))
+        link_use(values, use);
+}
+
 // TODO implement this
 IRValue Function::get_param(i32 index) {
     ARCVM_PROFILE();
     return IRValue{IRValueType::reference, index};
 }
 
+IRValue BasicBlock::label_value() {
+    return IRValue{IRValueType::label, label.symbol};
+}
+
+Entry* BasicBlock::new_entry(IRValue dest, Instruction instruction, Entry::Arguments const& arguments) {
+    if(entry_run_left == 0) {
+        entry_run_size = std::min(entry_run_size ? entry_run_size * 2 : 8, 256);
+        entry_run = arena.make_array<Entry>(entry_run_size);
+        entry_run_left = entry_run_size;
+    }
+    --entry_run_left;
+    auto* entry = entry_run++;
+    entry->dest_ = dest;
+    entry->instruction_ = instruction;
+    entry->argument_count = (u32)arguments.size();
+    entry->arguments_ = new_operands(entry->argument_count);
+    std::copy(arguments.begin(), arguments.end(), entry->arguments_);
+    return entry;
+}
+
+// an argument list longer than what's left of the run starts a new one and the rest goes unused
+IRValue* BasicBlock::new_operands(u32 count) {
+    if(count == 0)
+        return nullptr;
+    if(operand_run_left < (i32)count) {
+        operand_run_size = std::max(std::min(operand_run_size ? operand_run_size * 2 : 32, 1024), (i32)count);
+        operand_run = arena.make_array<IRValue>(operand_run_size);
+        operand_run_left = operand_run_size;
+    }
+    operand_run_left -= (i32)count;
+    auto* operands = operand_run;
+    operand_run += count;
+    return operands;
+}
+
+void BasicBlock::push_columns(Entry const& entry) {
+    instructions.push_back(entry.instruction_);
+    dests.push_back(entry.dest_);
+    types.push_back(explicit_type(entry));
+    removed.push_back(false);
+}
+
+void BasicBlock::link(Entry* entry, Use* uses) {
+    if(entry->dest_.type != IRValueType::none)
+        value_info(values, entry->dest_.value).def = entry;
+    if(entry->argument_count == 0)
+        return;
+    entry->uses_ = uses ? uses : arena.make_array<Use>(entry->argument_count);
+    for(u32 i = 0; i < entry->argument_count; ++i) {
+        entry->uses_[i] = Use{entry, i};
+        if(is_value(entry->arguments_[i]))
+            link_use(values, &entry->uses_[i]);
+    }
+}
+
+void BasicBlock::unlink(Entry* entry) {
+    if(entry->dest_.type != IRValueType::none && values[entry->dest_.value].def == entry)
+        values[entry->dest_.value].def = nullptr;
+    if(!entry->uses_)
+        return;
+    for(u32 i = 0; i < entry->argument_count; ++i)
+        if(is_value(entry->arguments_[i]))
+            unlink_use(values, &entry->uses_[i]);
+    entry->uses_ = nullptr;
+}
+
+void BasicBlock::append_entry(IRValue dest, Instruction instruction, Entry::Arguments const& arguments) {
+    entries_.push_back(new_entry(dest, instruction, arguments));
+    push_columns(*entries_.back());
+    link(entries_.back());
+}
+
+void BasicBlock::replace_entry(size_t index, IRValue dest, Instruction instruction, Entry::Arguments const& arguments) {
+    assert(!removed[index]);
+    instructions[index] = instruction;
+    dests[index] = dest;
+    types[index] = explicit_type(std::span<IRValue const>{arguments.data(), arguments.size()});
+    auto* replaced = entries_[index];
+    // the arena never frees the old operands and Use array, so keep them when the new arguments fit exactly
+    Use* uses = nullptr;
+    if(replaced->argument_count == arguments.size())
+        uses = replaced->uses_;
+    unlink(replaced);
+    if(!uses)
+        replaced->arguments_ = new_operands((u32)arguments.size());
+    replaced->dest_ = dest;
+    replaced->instruction_ = instruction;
+    replaced->argument_count = (u32)arguments.size();
+    std::copy(arguments.begin(), arguments.end(), replaced->arguments_);
+    link(replaced, uses);
+}
+
+void BasicBlock::remove_entry(size_t index) {
+    if(removed[index])
+        return;
+    unlink(entries_[index]);
+    removed[index] = true;
+    ++removed_count;
+}
+
+void BasicBlock::insert_entry(size_t index, IRValue dest, Instruction instruction, Entry::Arguments const& arguments) {
+    assert(index <= entries_.size());
+    auto* inserted = new_entry(dest, instruction, arguments);
+    link(inserted);
+    pending_inserts.emplace_back(index, inserted);
+}
+
+bool BasicBlock::columns_match() const {
+    if(instructions.size() != entries_.size() || dests.size() != entries_.size() || types.size() != entries_.size())
+        return false;
+    for(size_t i = 0; i < entries_.size(); ++i) {
+        if(removed[i])
+            continue;
+        auto const& entry = *entries_[i];
+        if(entry.instruction_ != instructions[i] || entry.dest_.type != dests[i].type
+           || entry.dest_.value != dests[i].value || explicit_type(entry) != types[i])
+            return false;
+    }
+    return true;
+}
+
+void BasicBlock::compact() {
+    ARCVM_PROFILE();
+    assert(columns_match());
+    if(is_compact())
+        return;
+    std::stable_sort(pending_inserts.begin(), pending_inserts.end(),
+                     [](auto const& a, auto const& b) { return a.first < b.first; });
+    auto old_entries = std::move(entries_);
+    auto old_instructions = std::move(instructions);
+    auto old_dests = std::move(dests);
+    auto old_types = std::move(types);
+    auto old_removed = std::move(removed);
+    entries_.clear();
+    instructions.clear();
+    dests.clear();
+    types.clear();
+    removed.clear();
+    auto size = old_entries.size() - removed_count + pending_inserts.size();
+    entries_.reserve(size);
+    instructions.reserve(size);
+    dests.reserve(size);
+    types.reserve(size);
+    removed.reserve(size);
+
+    size_t next_insert = 0;
+    for(size_t i = 0; i <= old_entries.size(); ++i) {
+        for(; next_insert < pending_inserts.size() && pending_inserts[next_insert].first == i; ++next_insert) {
+            entries_.push_back(pending_inserts[next_insert].second);
+            push_columns(*entries_.back());
+        }
+        if(i == old_entries.size() || old_removed[i])
+            continue;
+        entries_.push_back(old_entries[i]);
+        instructions.push_back(old_instructions[i]);
+        dests.push_back(old_dests[i]);
+        types.push_back(old_types[i]);
+        removed.push_back(false);
+    }
+    removed_count = 0;
+    pending_inserts.clear();
+}
+
 IRValue BasicBlock::gen_inst(Instruction instruction, IRValue value) {
     ARCVM_PROFILE();
-    return gen_inst(instruction, std::vector{value});
+    return gen_inst(instruction, Entry::Arguments{value});
 }
 
 // FIXME there is a lot of code duplication here
-IRValue BasicBlock::gen_inst(Instruction instruction, std::vector<IRValue> values) {
+IRValue BasicBlock::gen_inst(Instruction instruction, Entry::Arguments values) {
     ARCVM_PROFILE();
+    for(auto& value : values)
+        if((value.type == IRValueType::label || value.type == IRValueType::fn_name) && !value.interned)
+            value = IRValue{value.type, symbols.intern(*value.str_value)};
     switch(instruction) {
         case Instruction::add:
         case Instruction::sub:
@@ -105,41 +369,41 @@ IRValue BasicBlock::gen_inst(Instruction instruction, std::vector<IRValue> value
         case Instruction::neg:
         case Instruction::phi:
         case Instruction::dup:
-            entries.push_back(new Entry{IRValue{IRValueType::reference, var_name}, instruction, values});
+            append_entry(IRValue{IRValueType::reference, var_name}, instruction, values);
             ++var_name;
-            return entries.back()->dest;
+            return entries_.back()->dest();
         case Instruction::index:
-            entries.push_back(new Entry{IRValue{IRValueType::pointer, var_name}, instruction, values});
+            append_entry(IRValue{IRValueType::pointer, var_name}, instruction, values);
             ++var_name;
-            return entries.back()->dest;
+            return entries_.back()->dest();
         case Instruction::call:
             // FIXME return type is set to none
-            entries.push_back(new Entry{IRValue{IRValueType::reference, var_name}, instruction, values});
+            append_entry(IRValue{IRValueType::reference, var_name}, instruction, values);
             ++var_name;
-            return entries.back()->dest;
+            return entries_.back()->dest();
         case Instruction::ret:
-            entries.push_back(new Entry{IRValue{IRValueType::none}, instruction, values});
-            return entries.back()->dest;
+            append_entry(IRValue{IRValueType::none}, instruction, values);
+            return entries_.back()->dest();
         case Instruction::alloc:
-            entries.push_back(new Entry{IRValue{IRValueType::pointer, var_name}, instruction, values});
+            append_entry(IRValue{IRValueType::pointer, var_name}, instruction, values);
             ++var_name;
-            return entries.back()->dest;
+            return entries_.back()->dest();
         case Instruction::load:
-            entries.push_back(new Entry{IRValue{IRValueType::reference, var_name}, instruction, values});
+            append_entry(IRValue{IRValueType::reference, var_name}, instruction, values);
             ++var_name;
-            return entries.back()->dest;
+            return entries_.back()->dest();
         case Instruction::store:
-            entries.push_back(new Entry{IRValue{IRValueType::none}, instruction, values});
-            return entries.back()->dest;
+            append_entry(IRValue{IRValueType::none}, instruction, values);
+            return entries_.back()->dest();
         case Instruction::br:
-            entries.push_back(new Entry{IRValue{IRValueType::none}, instruction, values});
-            return entries.back()->dest;
+            append_entry(IRValue{IRValueType::none}, instruction, values);
+            return entries_.back()->dest();
         case Instruction::brz:
-            entries.push_back(new Entry{IRValue{IRValueType::none}, instruction, values});
-            return entries.back()->dest;
+            append_entry(IRValue{IRValueType::none}, instruction, values);
+            return entries_.back()->dest();
         case Instruction::brnz:
-            entries.push_back(new Entry{IRValue{IRValueType::none}, instruction, values});
-            return entries.back()->dest;
+            append_entry(IRValue{IRValueType::none}, instruction, values);
+            return entries_.back()->dest();
         default:
             return IRValue{IRValueType::none};
     }
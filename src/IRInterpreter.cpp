@@ -1,386 +1,703 @@
 #include "IRInterpreter.h"
 
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <iostream>
 
-// TODO cleanup and turn into a function
-#define CAST_IF_TYPED_BIN_OP() do {                                                \
-                                   if(entry->arguments.size() == 3)                \
-                                       switch(entry->arguments[2].type_value) {    \
-                                           case Type::ir_b1:                       \
-                                           case Type::ir_b8:                       \
-                                           case Type::ir_i8:                       \
-                                               return (i8)result;                  \
-                                           case Type::ir_u8:                       \
-                                               return (u8)result;                  \
-                                           case Type::ir_i16:                      \
-                                               return (i16)result;                 \
-                                           case Type::ir_u16:                      \
-                                               return (u16)result;                 \
-                                           case Type::ir_i32:                      \
-                                               return (i32)result;                 \
-                                           case Type::ir_u32:                      \
-                                               return (u32)result;                 \
-                                           case Type::ir_i64:                      \
-                                               return (i64)result;                 \
-                                           case Type::ir_u64:                      \
-                                               return (u64)result;                 \
-                                           default:                                \
-                                               assert(false);                      \
-                                       }                                           \
-                               } while(false)                                      \
+#ifdef _WIN32
+    #include <io.h>
+#else
+    #include <unistd.h>
+#endif
 
 using namespace arcvm;
 
-IRInterpreter::IRInterpreter(Module* module)
-    : module_{module}, jump_table{}, function_table{}, entrypoint_name{}, predecessor_stack{}, ir_register{} {}
+// ARCVM_THREADED_DISPATCH selects direct threading with labels-as-values where the compiler
+// supports it, every handler then ends in its own indirect jump instead of sharing the switch's
+#if defined(ARCVM_THREADED_DISPATCH) && defined(__linux__) && (defined(__GNUC__) || defined(__clang__))
+    #define ARCVM_COMPUTED_GOTO
+#endif
+
+#ifdef ARCVM_COMPUTED_GOTO
+    #define HANDLER(name) handle_##name:
+    #define NEXT() TRACE_OP(); code = &function->code[pc++]; COUNT_OP_PAIR(); goto *dispatch_table[(size_t)code->opcode]
+    #define DISPATCH() NEXT();
+#else
+    #define HANDLER(name) case OpCode::name:
+    #define NEXT() break
+    #define DISPATCH() TRACE_OP(); code = &function->code[pc++]; COUNT_OP_PAIR(); switch (code->opcode)
+#endif
+
+// the decoder always picks a typed opcode, the generic ones exist because every Instruction has a handler
+#define GENERIC_BIN_OP_HANDLER(name)                                                        \
+    HANDLER(name) {                                                                         \
+        auto lhs = reg(code->a);                                                            \
+        auto rhs = reg(code->b);                                                            \
+        reg(code->dest) = fold_bin_op(Instruction::name, code->type, lhs, rhs);             \
+        NEXT();                                                                             \
+    }
+
+#define TYPED_BIN_OP_HANDLER(name, type)                                                    \
+    HANDLER(name##_##type) {                                                                \
+        auto lhs = reg(code->a);                                                            \
+        auto rhs = reg(code->b);                                                            \
+        reg(code->dest) = typed_bin_op<Instruction::name, type>(lhs, rhs);                  \
+        NEXT();                                                                             \
+    }
+
+#define TYPED_BIN_OP_HANDLERS(name) ARCVM_INTEGRAL_TYPES(TYPED_BIN_OP_HANDLER, name)
+
+// the decoder always picks a width for loads and stores, this is the same access with_memory_type does
+#define TYPED_LOAD_HANDLER(name, type)                                                      \
+    HANDLER(load_##type) {                                                                  \
+        reg(code->dest) = *reinterpret_cast<type*>(reg(code->a));                           \
+        NEXT();                                                                             \
+    }
+
+#define TYPED_STORE_HANDLER(name, type)                                                     \
+    HANDLER(store_##type) {                                                                 \
+        *reinterpret_cast<type*>(reg(code->a)) = static_cast<type>(reg(code->b));           \
+        NEXT();                                                                             \
+    }
+
+#define TYPED_ALLOC_STORE_HANDLER(name, type)                                               \
+    HANDLER(alloc_store_##type) {                                                           \
+        auto* ptr = stack_memory.allocate(std::max(code->x, 8), 8);                         \
+        reg(code->dest) = (i64)(uintptr_t)ptr;                                              \
+        *reinterpret_cast<type*>(ptr) = static_cast<type>(reg(code->b));                    \
+        NEXT();                                                                             \
+    }
+
+#define TYPED_INC_MEM_HANDLER(name, type)                                                   \
+    HANDLER(inc_mem_##type) {                                                               \
+        auto* ptr = reinterpret_cast<type*>(reg(code->a));                                  \
+        *ptr = static_cast<type>(*ptr + code->b);                                           \
+        NEXT();                                                                             \
+    }
+
+// only fused when the op's own type is at least as wide as memory, truncating to type is the same
+#define TYPED_LOAD_OP_STORE_HANDLER(name, type)                                             \
+    HANDLER(load_##name##_store_##type) {                                                   \
+        auto* ptr = reinterpret_cast<type*>(reg(code->a));                                  \
+        auto rhs = reg(code->b);                                                            \
+        *ptr = static_cast<type>(bin_op<Instruction::name>(*ptr, rhs));                     \
+        NEXT();                                                                             \
+    }
+
+#define TYPED_LOAD_OP_STORE_HANDLERS(name) ARCVM_MEMORY_TYPES(TYPED_LOAD_OP_STORE_HANDLER, name)
+
+#define CMP_BRANCH_HANDLER(name)                                                            \
+    HANDLER(br_##name) {                                                                    \
+        auto lhs = reg(code->a);                                                            \
+        auto rhs = reg(code->b);                                                            \
+        pc = bin_op<Instruction::name>(lhs, rhs) ? code->x : code->y;                       \
+        NEXT();                                                                             \
+    }
+
+// ARCVM_TRACE compiles in the check for enable_tracing, without it dispatch doesn't test anything
+// with tracing on, every op is recorded right before the next one is fetched
+// ops that switch frames record themselves first and clear code so they aren't recorded twice
+#ifdef ARCVM_TRACE
+    #define TRACE_OP()                                                                      \
+        if(tracing && code)                                                                 \
+            trace_op(function, code, code->dest >= 0 ? reg(code->dest) : 0)
+
+    #define TRACE_FRAME_SWITCH(result)                                                      \
+        if(tracing) {                                                                       \
+            trace_op(function, code, result);                                               \
+            code = nullptr;                                                                 \
+        }
+#else
+    #define TRACE_OP() (void)0
+    #define TRACE_FRAME_SWITCH(result) (void)0
+#endif
+
+// ARCVM_COUNT_OP_PAIRS counts every pair of opcodes that run back to back
+#ifdef ARCVM_COUNT_OP_PAIRS
+    #define COUNT_OP_PAIR() count_op_pair(code->opcode)
+#else
+    #define COUNT_OP_PAIR() (void)0
+#endif
+
+// calls f with a value of the type memory is accessed as
+// signed and unsigned types of the same width are accessed the same way, untyped is i64
+template <typename F>
+static inline void with_memory_type(Type type, F&& f) {
+    switch(type) {
+        case Type::ir_b1:
+        case Type::ir_b8:
+        case Type::ir_i8:
+        case Type::ir_u8:
+            f((i8)0);
+            break;
+        case Type::ir_i16:
+        case Type::ir_u16:
+            f((i16)0);
+            break;
+        case Type::ir_i32:
+        case Type::ir_u32:
+            f((i32)0);
+            break;
+        default:
+            f((i64)0);
+    }
+}
+
+// the interpreter running on this thread, for dumping its trace when an assert fails
+static thread_local IRInterpreter* running_interpreter = nullptr;
+
+IRInterpreter::IRInterpreter(Module* module): IRInterpreter(std::vector<Module*>{module}) {}
+
+IRInterpreter::IRInterpreter(std::vector<Module*> modules)
+    : modules_{std::move(modules)}, bytecode_{}, call_stack{}, register_stack{}, stack_memory{} {
+#ifdef ARCVM_COUNT_OP_PAIRS
+    op_pair_counts.resize(opcode_count * opcode_count);
+#endif
+}
+
+IRInterpreter::IRInterpreter(FrozenModule bytecode)
+    : modules_{}, bytecode_{std::move(bytecode)}, call_stack{}, register_stack{}, stack_memory{} {
+#ifdef ARCVM_COUNT_OP_PAIRS
+    op_pair_counts.resize(opcode_count * opcode_count);
+#endif
+}
+
+IRInterpreter::~IRInterpreter() {
+    if(running_interpreter == this)
+        running_interpreter = nullptr;
+}
 
 i32 IRInterpreter::run() {
     ARCVM_PROFILE();
-    return run_module(module_);
+    if(bytecode_)
+        return run_entry_function();
+    return run_modules(modules_);
 }
 
-void IRInterpreter::build_jump_table(Module* module) {
+i32 IRInterpreter::run_module(Module* module) {
     ARCVM_PROFILE();
-    for (auto* function : module->functions) {
-        for (auto const& attribute : function->attributes) {
-            if (attribute == Attribute::entrypoint)
-                entrypoint_name = function->name;
-        }
-        for (size_t i = 0; i < function->block->blocks.size(); ++i) {
-            auto* basicblock = function->block->blocks[i];
-            jump_table.emplace(basicblock->label.name, basicblock);
-            function_table.emplace(basicblock->label.name, function);
-        }
-    }
+    return run_modules({module});
 }
 
-i32 IRInterpreter::run_module(Module* module) {
+// every module is decoded into the same context so they can call each other
+i32 IRInterpreter::run_modules(std::vector<Module*> const& modules) {
     ARCVM_PROFILE();
-    build_jump_table(module);
+    for(auto* module : modules)
+        module->compact();  // in case entries were removed or inserted outside of a pass
+    IRDecoder decoder{profiling};
+    bytecode_ = decoder.freeze(modules);
     return run_entry_function();
 }
 
 i32 IRInterpreter::run_entry_function() {
     ARCVM_PROFILE();
+    profile_counts.assign(bytecode_->profile_points.size(), 0);
     // TODO pass command line arguments here
-    IRValue ret_val = run_function(function_table.at(entrypoint_name), {});
+    IRValue ret_val = run_function(bytecode_->entrypoint, {});
+#ifdef ARCVM_COUNT_OP_PAIRS
+    print_op_pairs(20);
+#endif
     if (ret_val.type != IRValueType::none)
         return static_cast<i32>(ret_val.value);
     return 0;
 }
 
-IRValue IRInterpreter::run_function(Function* function, std::vector<IRValue> args) {
+IRValue IRInterpreter::run_function(i32 index, std::span<IRValue const> args) {
     ARCVM_PROFILE();
-    // put args in after adding new register context
-
-    ir_register.emplace_back();
-    for(size_t i = 0; i < args.size(); ++i) {
-        // FIXME
-        // assumes it's a reference to the calling context
-        // in theory it could be from any previous context
-        if(args[i].type == IRValueType::reference) {
-            auto& calling_context = ir_register.end()[-2];
-            ir_register.back()[i] = calling_context[args[i].value];
-        }
-        else    // assumes immediate
-            ir_register.back()[i] = args[i];
+    auto depth = call_stack.size();
+    auto const* function = &bytecode_->functions[index];
+    // callers can come straight here, counts carry over between calls until run_entry_function clears them
+    if(profile_counts.size() != bytecode_->profile_points.size())
+        profile_counts.assign(bytecode_->profile_points.size(), 0);
+    if(tiers.size() != bytecode_->functions.size())
+        tiers.assign(bytecode_->functions.size(), {});
+    running_interpreter = this;
+    auto base = push_registers(function);
+    for(size_t i = 0; i < args.size(); ++i)
+        reg(i) = args[i].value;
+    call_stack.push_back(Frame{function, 0, -1, base, stack_memory.mark()});
+    return run_frames(depth);
+}
+
+void IRInterpreter::print_op_pairs(size_t count) {
+    std::vector<size_t> pairs;
+    for(size_t i = 0; i < op_pair_counts.size(); ++i)
+        if(op_pair_counts[i] != 0)
+            pairs.push_back(i);
+    count = std::min(count, pairs.size());
+    std::partial_sort(pairs.begin(), pairs.begin() + count, pairs.end(), [&](size_t lhs, size_t rhs) {
+        return op_pair_counts[lhs] > op_pair_counts[rhs];
+    });
+    for(size_t i = 0; i < count; ++i) {
+        auto first = to_string(static_cast<OpCode>(pairs[i] / opcode_count));
+        auto second = to_string(static_cast<OpCode>(pairs[i] % opcode_count));
+        std::cout << first << ' ' << second << '\t' << op_pair_counts[pairs[i]] << '\n';
     }
-    auto result = run_block(function->block);
-    ir_register.pop_back();
-    return result;
 }
 
-IRValue IRInterpreter::run_block(Block* block) {
-    ARCVM_PROFILE();
-    return run_basicblock(block->blocks[0]);
+void IRInterpreter::enable_tiering(TierPolicy policy, TierCompiler compiler) {
+    tiering = true;
+    tier_policy = policy;
+    tier_compiler = std::move(compiler);
 }
 
-IRValue IRInterpreter::run_basicblock(BasicBlock* basicblock) {
-    ARCVM_PROFILE();
-    current_block_name = basicblock->label.name;
-    for (size_t i = 0; i < basicblock->entries.size(); ++i) {
-        auto ret_val = run_entry(basicblock->entries[i]);
-        if (ret_val.type != IRValueType::none)
-            return ret_val;
+IRInterpreter::FunctionTier& IRInterpreter::tier_of(BytecodeFunction const* function) {
+    return tiers[function - bytecode_->functions.data()];
+}
+
+void IRInterpreter::tier_up(FunctionTier& tier, BytecodeFunction const* function) {
+    if(tier.native || tier.failed)
+        return;
+    tier.native = tier_compiler(*function);
+    tier.failed = tier.native == nullptr;
+}
+
+void IRInterpreter::count_backedge(BytecodeFunction const* function) {
+    auto& tier = tier_of(function);
+    if(++tier.backedges >= tier_policy.backedge_threshold)
+        tier_up(tier, function);
+}
+
+void IRInterpreter::enable_memoization(size_t entries) {
+    size_t size = 1;
+    while(size < entries)
+        size *= 2;
+    memo_table.assign(size, {});
+}
+
+// true with the cached result if the call has been made before
+// otherwise the call's slot is claimed and handed back so the result can be filled in when it returns,
+// a call nested inside it can take the slot over but is always done first, so a slot still waiting
+// for its result when a memoized frame returns is that frame's
+bool IRInterpreter::memo_lookup(BytecodeFunction const* callee, Operand const* args, i32 count, i64& result, i32& slot) {
+    u64 hash = (uintptr_t)callee;
+    for(i32 i = 0; i < count; ++i)
+        hash = (hash ^ (u64)reg(args[i].value)) * 0x9E3779B97F4A7C15ull;
+    hash ^= hash >> 32;
+    slot = (i32)(hash & (memo_table.size() - 1));
+
+    auto& entry = memo_table[slot];
+    bool hit = entry.valid && entry.function == callee;
+    for(i32 i = 0; hit && i < count; ++i)
+        hit = entry.args[i] == reg(args[i].value);
+    if(hit) {
+        result = entry.result;
+        return true;
     }
-    return IRValue{IRValueType::none};
+    entry.function = callee;
+    for(i32 i = 0; i < count; ++i)
+        entry.args[i] = reg(args[i].value);
+    entry.valid = false;
+    return false;
 }
 
-// TODO there are a lot of common patterns here that can be extracted into macros
-//
-// FIXME this is purposely inefficient
-// fix at some point
-IRValue IRInterpreter::run_entry(Entry* entry) {
-    // ARCVM_PROFILE();
-    switch (entry->instruction) {
-        case Instruction::alloc: {
-            auto num_bytes = type_size(entry->arguments[0].type_value);
-            ir_register.back()[entry->dest.value] = IRValue(IRValueType::pointer, malloc(num_bytes));
-            break;
+void IRInterpreter::enable_tracing(size_t records) {
+    tracing = records != 0;
+    trace = TraceBuffer{records};
+}
+
+// appends to a fixed buffer and cuts off whatever doesn't fit, safe to use in a signal handler
+struct TraceLine {
+    char* data;
+    size_t size;
+    size_t length = 0;
+
+    void append(std::string_view str) {
+        auto count = std::min(str.size(), size - length);
+        std::memcpy(data + length, str.data(), count);
+        length += count;
+    }
+
+    void append(i64 value) {
+        char digits[20];
+        size_t count = 0;
+        u64 magnitude = value < 0 ? 0 - (u64)value : (u64)value;
+        do {
+            digits[count++] = (char)('0' + magnitude % 10);
+            magnitude /= 10;
+        } while(magnitude);
+        if(value < 0)
+            append("-");
+        while(count && length < size)
+            data[length++] = digits[--count];
+    }
+};
+
+size_t IRInterpreter::format_trace_record(TraceRecord const& record, char* buffer, size_t size) const {
+    auto const& function = bytecode_->functions[record.function];
+    // edge blocks come after every BasicBlock and don't have a label
+    std::string_view label = "edge";
+    if(record.block < (i32)function.block_labels.size())
+        label = function.block_labels[record.block];
+    // one byte is kept back so the line always ends in a newline
+    TraceLine line{buffer, size - 1};
+    line.append(function.name);
+    line.append(" ");
+    line.append(label);
+    line.append(" ");
+    line.append((i64)record.instruction);
+    line.append(" ");
+    line.append(to_string(function.code[record.instruction].opcode));
+    line.append(" ");
+    line.append(record.result);
+    buffer[line.length] = '\n';
+    return line.length + 1;
+}
+
+void IRInterpreter::dump_trace(std::ostream& out) {
+    char buffer[256];
+    trace.for_each([&](TraceRecord const& record) {
+        out.write(buffer, (std::streamsize)format_trace_record(record, buffer, sizeof(buffer)));
+    });
+    out.flush();
+}
+
+static void write_stderr(char const* data, size_t size) {
+    while(size > 0) {
+#ifdef _WIN32
+        auto written = _write(2, data, (unsigned)size);
+#else
+        auto written = write(STDERR_FILENO, data, size);
+#endif
+        if(written <= 0)
+            return;
+        data += written;
+        size -= (size_t)written;
+    }
+}
+
+// the handler can only make async-signal-safe calls, so no streams and nothing that allocates
+void IRInterpreter::dump_trace_on_abort() {
+    std::signal(SIGABRT, [](int) {
+        if(!running_interpreter || !running_interpreter->tracing)
+            return;
+        char buffer[256];
+        running_interpreter->trace.for_each([&](TraceRecord const& record) {
+            write_stderr(buffer, running_interpreter->format_trace_record(record, buffer, sizeof(buffer)));
+        });
+    });
+}
+
+void IRInterpreter::set_profiling(bool enabled) {
+    profiling = enabled;
+}
+
+void IRInterpreter::dump_profile(std::ostream& out) {
+    auto const& functions = bytecode_->functions;
+    auto const& points = bytecode_->profile_points;
+
+    // points[i] for every block of every function
+    std::vector<std::vector<std::vector<size_t>>> block_points(functions.size());
+    for(size_t f = 0; f < functions.size(); ++f)
+        block_points[f].resize(functions[f].block_labels.size());
+    for(size_t i = 0; i < points.size(); ++i)
+        block_points[points[i].function][points[i].block].push_back(i);
+
+    auto quoted = [](std::string const& str) {
+        std::string result = "\"";
+        for(auto c : str) {
+            if(c == '"' || c == '\\')
+                result += '\\';
+            result += c;
         }
-        case Instruction::load: {
-            // FIXME wow this workaround is hideous
-            // not much I can do though
-            auto load = [&]<std::integral T>(T t) {
-                auto* ptr = reinterpret_cast<T*>(ir_register.back()[entry->arguments[0].value].pointer_value);
-                ir_register.back()[entry->dest.value] = IRValue(IRValueType::immediate, *ptr);
-            };
-            if(entry->arguments.size() > 1) {
-                switch(entry->arguments[1].type_value) {
-                    case Type::ir_b1:
-                    case Type::ir_b8:
-                    case Type::ir_i8:
-                    case Type::ir_u8:
-                        load((i8)0);
+        return result + '"';
+    };
+
+    out << "{";
+    for(size_t f = 0; f < functions.size(); ++f) {
+        auto const& function = functions[f];
+        out << (f ? ",\n" : "\n") << "  " << quoted(function.name) << ": {";
+        bool first_block = true;
+        for(auto id : function.block_layout) {
+            auto const& indices = block_points[f][id];
+            if(indices.empty())
+                continue;
+            out << (first_block ? "\n" : ",\n") << "    " << quoted(function.block_labels[id]) << ": {";
+            first_block = false;
+            std::string calls;
+            bool first_field = true;
+            for(auto i : indices) {
+                auto field = [&](char const* name) {
+                    out << (first_field ? "" : ", ") << '"' << name << "\": " << profile_counts[i];
+                    first_field = false;
+                };
+                switch(points[i].kind) {
+                    case ProfileKind::block:
+                        field("count");
                         break;
-                    case Type::ir_i16:
-                    case Type::ir_u16:
-                        load((i16)0);
+                    case ProfileKind::taken:
+                        field("taken");
                         break;
-                    case Type::ir_i32:
-                    case Type::ir_u32:
-                        load((i32)0);
+                    case ProfileKind::not_taken:
+                        field("not_taken");
                         break;
-                    case Type::ir_i64:
-                    case Type::ir_u64:
-                        load((i64)0);
+                    case ProfileKind::call:
+                        calls += calls.empty() ? "" : ", ";
+                        calls += "{\"callee\": " + quoted(functions[points[i].callee].name) +
+                            ", \"count\": " + std::to_string(profile_counts[i]) + "}";
                         break;
-                    default:
-                        load((i64)0);
                 }
             }
-            else {
-                load((i64)0);
-            }
-            break;
+            if(!calls.empty())
+                out << (first_field ? "" : ", ") << "\"calls\": [" << calls << "]";
+            out << "}";
         }
-        case Instruction::store: {
-            // another hideous workaround :)
-            auto store = [&]<std::integral T>(T t) {
-                if (entry->arguments[1].type == IRValueType::immediate) {
-                    auto* ptr = reinterpret_cast<T*>(ir_register.back()[entry->arguments[0].value].pointer_value);
-                    *ptr = static_cast<T>(entry->arguments[1].value);
-                } else if (entry->arguments[1].type == IRValueType::reference) {
-                    auto* ptr = reinterpret_cast<T*>(ir_register.back()[entry->arguments[0].value].pointer_value);
-                    *ptr = static_cast<T>(ir_register.back()[entry->arguments[1].value].value);
+        out << "\n  }";
+    }
+    out << "\n}\n";
+}
+
+// reserves a new frame for function on top of the register stack and makes it the current one
+// registers are not cleared, SSA guarantees every value is written before it is read,
+// only the function's constants are copied in
+size_t IRInterpreter::push_registers(BytecodeFunction const* function) {
+    auto base = register_top;
+    register_top += function->register_count;
+    if(register_top > register_stack.size())
+        register_stack.resize(std::max(register_top, register_stack.size() * 2));
+    registers = register_stack.data() + base;
+    std::copy(function->constants.begin(), function->constants.end(), registers + function->constant_base);
+    return base;
+}
+
+// the callee of a tail call takes over the frame, so whatever it can't reach is released
+// nothing outside the frame's registers can point into its memory unless function says so, then it all
+// stays until the frame returns. otherwise only the tail call's arguments can, allocations they point
+// into are moved down over the released memory, as long as function allocated them itself
+void IRInterpreter::release_tail_call_memory(BytecodeFunction const* function) {
+    auto& frame = call_stack.back();
+    auto top = stack_memory.mark();
+    if(function->allocations_escape || (frame.shares_memory && function->parameters_escape)) {
+        frame.tail_mark = frame.activation_mark = top;
+        frame.shares_memory = false;
+        return;
+    }
+    auto points_into = [&](Arena::Mark from, Arena::Mark to) {
+        return std::any_of(tail_args.begin(), tail_args.end(), [&](i64 arg) {
+            return stack_memory.allocated_between(from, to, (void const*)(uintptr_t)arg);
+        });
+    };
+    auto into_own = points_into(frame.activation_mark, top);
+    if(points_into(frame.tail_mark, frame.activation_mark)) {
+        if(!into_own)
+            stack_memory.release(frame.activation_mark);
+    }
+    else if(!into_own) {
+        stack_memory.release(frame.tail_mark);
+    }
+    else if(auto moved = stack_memory.move_down(frame.activation_mark, frame.tail_mark, 8)) {
+        for(auto& arg : tail_args)
+            if(stack_memory.allocated_between(frame.activation_mark, top, (void const*)(uintptr_t)arg))
+                arg += *moved;
+    }
+    frame.activation_mark = stack_memory.mark();
+    frame.shares_memory = points_into(frame.tail_mark, frame.activation_mark);
+}
+
+// labels as values and computed goto are GNU extensions, -pedantic warns about every use
+#ifdef ARCVM_COMPUTED_GOTO
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+// runs until the call stack unwinds back to depth
+// calls and returns push and pop Frames instead of recursing so the native stack stays flat
+IRValue IRInterpreter::run_frames(size_t depth) {
+    auto const* function = call_stack.back().function;
+    i32 pc = call_stack.back().pc;
+    Op const* code = nullptr;
+    IRValue result;
+#ifdef ARCVM_COMPUTED_GOTO
+    // same order as OpCode
+    static void* const dispatch_table[] = {
+#define ARCVM_HANDLER_ADDRESS(name) &&handle_##name,
+#define ARCVM_TYPED_HANDLER_ADDRESS(name, type) &&handle_##name##_##type,
+#define ARCVM_TYPED_HANDLER_ADDRESSES(name) ARCVM_INTEGRAL_TYPES(ARCVM_TYPED_HANDLER_ADDRESS, name)
+#define ARCVM_MEMORY_HANDLER_ADDRESSES(name) ARCVM_MEMORY_TYPES(ARCVM_TYPED_HANDLER_ADDRESS, name)
+#define ARCVM_LOAD_OP_STORE_HANDLER_ADDRESSES(name) ARCVM_MEMORY_TYPES(ARCVM_TYPED_HANDLER_ADDRESS, load_##name##_store)
+        ARCVM_INSTRUCTIONS(ARCVM_HANDLER_ADDRESS)
+        ARCVM_BIN_OPS(ARCVM_TYPED_HANDLER_ADDRESSES)
+        ARCVM_SUPERINSTRUCTIONS(ARCVM_HANDLER_ADDRESS)
+        ARCVM_MEMORY_OPS(ARCVM_MEMORY_HANDLER_ADDRESSES)
+        ARCVM_FUSED_MEMORY_OPS(ARCVM_MEMORY_HANDLER_ADDRESSES)
+        ARCVM_BIN_OPS(ARCVM_LOAD_OP_STORE_HANDLER_ADDRESSES)
+        ARCVM_PROFILE_OPS(ARCVM_HANDLER_ADDRESS)
+#undef ARCVM_LOAD_OP_STORE_HANDLER_ADDRESSES
+#undef ARCVM_MEMORY_HANDLER_ADDRESSES
+#undef ARCVM_TYPED_HANDLER_ADDRESSES
+#undef ARCVM_TYPED_HANDLER_ADDRESS
+#undef ARCVM_HANDLER_ADDRESS
+    };
+#endif
+    while(true) {
+        DISPATCH() {
+            HANDLER(alloc) {
+                // untyped loads and stores access a whole i64 so nothing is smaller than that
+                auto num_bytes = std::max(type_size(code->type), 8);
+                auto* ptr = stack_memory.allocate(num_bytes, 8);
+                reg(code->dest) = (i64)(uintptr_t)ptr;
+                NEXT();
+            }
+            HANDLER(load) {
+                with_memory_type(code->type, [&]<std::integral T>(T) {
+                    auto* ptr = reinterpret_cast<T*>(reg(code->a));
+                    reg(code->dest) = *ptr;
+                });
+                NEXT();
+            }
+            HANDLER(store) {
+                with_memory_type(code->type, [&]<std::integral T>(T) {
+                    auto* ptr = reinterpret_cast<T*>(reg(code->a));
+                    *ptr = static_cast<T>(reg(code->b));
+                });
+                NEXT();
+            }
+            HANDLER(call) {
+                call_stack.back().pc = pc;
+                auto const* callee = reinterpret_cast<BytecodeFunction const*>((uintptr_t)code->a);
+                if(tiering) {
+                    auto& tier = tier_of(callee);
+                    if(++tier.calls >= tier_policy.call_threshold)
+                        tier_up(tier, callee);
+                    if(tier.native) {
+                        tail_args.clear();
+                        for(i32 i = 0; i < code->y; ++i)
+                            tail_args.push_back(reg(function->operand_pool[code->x + i].value));
+                        reg(code->dest) = tier.native(tail_args.data());
+                        NEXT();
+                    }
                 }
-            };
-
-            if(entry->arguments.size() > 2) {
-                switch(entry->arguments[2].type_value) {
-                    case Type::ir_b1:
-                    case Type::ir_b8:
-                    case Type::ir_i8:
-                    case Type::ir_u8:
-                        store((i8)0);
-                        break;
-                    case Type::ir_i16:
-                    case Type::ir_u16:
-                        store((i16)0);
-                        break;
-                    case Type::ir_i32:
-                    case Type::ir_u32:
-                        store((i32)0);
-                        break;
-                    case Type::ir_i64:
-                    case Type::ir_u64:
-                        store((i64)0);
-                        break;
-                    default:
-                        store((i64)0);
+                i32 memo_slot = -1;
+                if(callee->pure && !memo_table.empty() && code->y <= memo_max_args) {
+                    i64 cached;
+                    if(memo_lookup(callee, &function->operand_pool[code->x], code->y, cached, memo_slot)) {
+                        reg(code->dest) = cached;
+                        NEXT();
+                    }
                 }
+                auto base = push_registers(callee);
+                // pushing can move the stack so the caller is found through its base
+                auto* caller = register_stack.data() + call_stack.back().base;
+                // parameters are the callee's first registers, arguments go straight into them
+                for(i32 i = 0; i < code->y; ++i)
+                    registers[i] = caller[function->operand_pool[code->x + i].value];
+                call_stack.push_back(Frame{callee, 0, code->dest, base, stack_memory.mark(), memo_slot});
+                TRACE_FRAME_SWITCH(0);
+                function = callee;
+                pc = 0;
+                NEXT();
             }
-            else {
-                store((i64)0);
+            HANDLER(ret) {
+                result = IRValue{IRValueType::none};
+                if(code->a_kind == OperandKind::reg)
+                    result = reg(code->a);
+                TRACE_FRAME_SWITCH(result.type == IRValueType::none ? 0 : result.value);
+            pop_frame:
+                if(call_stack.back().memo_slot >= 0) {
+                    auto& entry = memo_table[call_stack.back().memo_slot];
+                    if(!entry.valid) {
+                        entry.result = result.value;
+                        entry.valid = true;
+                    }
+                }
+                auto dest = call_stack.back().dest;
+                register_top = call_stack.back().base;
+                stack_memory.release(call_stack.back().stack_mark);
+                call_stack.pop_back();
+                if(!call_stack.empty())
+                    registers = register_stack.data() + call_stack.back().base;
+                if(call_stack.size() == depth)
+                    return result;
+                function = call_stack.back().function;
+                pc = call_stack.back().pc;
+                reg(dest) = result.value;
+                NEXT();
             }
-            break;
-        }
-        case Instruction::call: {
-            auto args = entry->arguments;
-            // remove function name
-            args.erase(args.begin(), args.begin()+1);
-            // remove return type
-            args.pop_back();
-            auto label_name = *(entry->arguments[0].str_value);
-            ir_register.back()[entry->dest.value] = run_function(function_table.at(label_name), args);
-            break;
-        }
-        case Instruction::ret: {
-            if(entry->arguments[0].type == IRValueType::immediate)
-                return entry->arguments[0].value;
-            remove_predecessor();
-            // assumes you are returning an index
-            return ir_register.back()[entry->arguments[0].value];
-        }
-        case Instruction::br: {
-            auto label_name = *(entry->arguments[0].str_value);
-            add_predecessor(current_block_name);
-            return run_basicblock(jump_table[label_name]);
-        }
-        case Instruction::brz: {
-            auto val = ir_register.back()[entry->arguments[0].value].value;
-            auto label_name = *(entry->arguments[1].str_value);
-            auto label_name2 = *(entry->arguments[2].str_value);
-
-            add_predecessor(current_block_name);
-            if(val == 0)
-                return run_basicblock(jump_table[label_name]);
-            else
-                return run_basicblock(jump_table[label_name2]);
-        }
-        case Instruction::brnz: {
-            auto val = ir_register.back()[entry->arguments[0].value].value;
-            auto label_name = *(entry->arguments[1].str_value);
-            auto label_name2 = *(entry->arguments[2].str_value);
-
-            add_predecessor(current_block_name);
-            if(val != 0)
-                return run_basicblock(jump_table[label_name]);
-            else
-                return run_basicblock(jump_table[label_name2]);
-        }
-        case Instruction::phi: {
-            if(entry->arguments.size() & 1)
-                assert(false);  // TODO handle casts and change how they function for all instructions
-
-            bool found_bblock_name = false;
-
-            for(int i = 0; i < entry->arguments.size(); i += 2) {
-                auto label_name = *(entry->arguments[i].str_value);
-                if(label_name == predecessor()) {
-                    found_bblock_name = true;
-                    auto result = unpack(entry->arguments[i + 1]);
-                    ir_register.back()[entry->dest.value] = result;
-                    break;
+            HANDLER(tail_call) {
+                auto const* callee = reinterpret_cast<BytecodeFunction const*>((uintptr_t)code->a);
+                if(tiering) {
+                    auto& tier = tier_of(callee);
+                    if(++tier.calls >= tier_policy.call_threshold)
+                        tier_up(tier, callee);
+                }
+                // arguments can read registers that the callee's parameters overwrite
+                tail_args.clear();
+                for(i32 i = 0; i < code->y; ++i)
+                    tail_args.push_back(reg(function->operand_pool[code->x + i].value));
+                if(tiering && tier_of(callee).native) {
+                    TRACE_FRAME_SWITCH(0);
+                    result = tier_of(callee).native(tail_args.data());
+                    goto pop_frame;
                 }
+                release_tail_call_memory(function);
+                register_top = call_stack.back().base;
+                push_registers(callee);
+                std::copy(tail_args.begin(), tail_args.end(), registers);
+                TRACE_FRAME_SWITCH(0);
+                function = callee;
+                pc = 0;
+                call_stack.back().function = function;
+                NEXT();
             }
-            if(!found_bblock_name)
-                assert(false);  // could not find basic block name
-            break;
-        }
-        case Instruction::dup: {
-            ir_register.back()[entry->dest.value] = unpack(entry->arguments[0]);
-            break;
-        }
-        case Instruction::index: {
-            auto* ptr = reinterpret_cast<i8*>(ir_register.back()[entry->arguments[0].value].pointer_value);
-            ptr += unpack(entry->arguments[1]);
-            ir_register.back()[entry->dest.value].pointer_value = (uintptr_t)ptr;
-            break;
-        }
-        case Instruction::add: {
-            auto result = unpack(entry->arguments[0]) + unpack(entry->arguments[1]);
-            CAST_IF_TYPED_BIN_OP();
-            ir_register.back()[entry->dest.value] = IRValue{IRValueType::immediate, result};
-            break;
-        }
-        case Instruction::sub: {
-            auto result = unpack(entry->arguments[0]) - unpack(entry->arguments[1]);
-            CAST_IF_TYPED_BIN_OP();
-            ir_register.back()[entry->dest.value] = IRValue{IRValueType::immediate, result};
-            break;
-        }
-        case Instruction::mul: {
-            auto result = unpack(entry->arguments[0]) * unpack(entry->arguments[1]);
-            CAST_IF_TYPED_BIN_OP();
-            ir_register.back()[entry->dest.value] = IRValue{IRValueType::immediate, result};
-            break;
-        }
-        case Instruction::div: {
-            auto result = unpack(entry->arguments[0]) / unpack(entry->arguments[1]);
-            CAST_IF_TYPED_BIN_OP();
-            ir_register.back()[entry->dest.value] = IRValue{IRValueType::immediate, result};
-            break;
-        }
-        case Instruction::mod: {
-            auto result = unpack(entry->arguments[0]) % unpack(entry->arguments[1]);
-            CAST_IF_TYPED_BIN_OP();
-            ir_register.back()[entry->dest.value] = IRValue{IRValueType::immediate, result};
-            break;
-        }
-        case Instruction::bin_or: {
-            auto result = unpack(entry->arguments[0]) | unpack(entry->arguments[1]);
-            CAST_IF_TYPED_BIN_OP();
-            ir_register.back()[entry->dest.value] = IRValue{IRValueType::immediate, result};
-            break;
-        }
-        case Instruction::bin_and: {
-            auto result = unpack(entry->arguments[0]) & unpack(entry->arguments[1]);
-            CAST_IF_TYPED_BIN_OP();
-            ir_register.back()[entry->dest.value] = IRValue{IRValueType::immediate, result};
-            break;
-        }
-        case Instruction::bin_xor: {
-            auto result = unpack(entry->arguments[0]) ^ unpack(entry->arguments[1]);
-            CAST_IF_TYPED_BIN_OP();
-            ir_register.back()[entry->dest.value] = IRValue{IRValueType::immediate, result};
-            break;
-        }
-        case Instruction::lshift: {
-            auto result = unpack(entry->arguments[0]) << unpack(entry->arguments[1]);
-            CAST_IF_TYPED_BIN_OP();
-            ir_register.back()[entry->dest.value] = IRValue{IRValueType::immediate, result};
-            break;
-        }
-        case Instruction::rshift: {
-            auto result = unpack(entry->arguments[0]) >> unpack(entry->arguments[1]);
-            CAST_IF_TYPED_BIN_OP();
-            ir_register.back()[entry->dest.value] = IRValue{IRValueType::immediate, result};
-            break;
-        }
-        case Instruction::lt: {
-            auto result = unpack(entry->arguments[0]) < unpack(entry->arguments[1]);
-            CAST_IF_TYPED_BIN_OP();
-            ir_register.back()[entry->dest.value] = IRValue{IRValueType::immediate, result};
-            break;
-        }
-        case Instruction::gt: {
-            auto result = unpack(entry->arguments[0]) > unpack(entry->arguments[1]);
-            CAST_IF_TYPED_BIN_OP();
-            ir_register.back()[entry->dest.value] = IRValue{IRValueType::immediate, result};
-            break;
-        }
-        case Instruction::lte: {
-            auto result = unpack(entry->arguments[0]) <= unpack(entry->arguments[1]);
-            CAST_IF_TYPED_BIN_OP();
-            ir_register.back()[entry->dest.value] = IRValue{IRValueType::immediate, result};
-            break;
-        }
-        case Instruction::gte: {
-            auto result = unpack(entry->arguments[0]) >= unpack(entry->arguments[1]);
-            CAST_IF_TYPED_BIN_OP();
-            ir_register.back()[entry->dest.value] = IRValue{IRValueType::immediate, result};
-            break;
-        }
-        case Instruction::eq: {
-            auto result = unpack(entry->arguments[0]) == unpack(entry->arguments[1]);
-            CAST_IF_TYPED_BIN_OP();
-            ir_register.back()[entry->dest.value] = IRValue{IRValueType::immediate, result};
-            break;
-        }
-        case Instruction::neq: {
-            auto result = unpack(entry->arguments[0]) != unpack(entry->arguments[1]);
-            CAST_IF_TYPED_BIN_OP();
-            ir_register.back()[entry->dest.value] = IRValue{IRValueType::immediate, result};
-            break;
-        }
-        case Instruction::neg: {
-            auto result = -unpack(entry->arguments[0]);    // TODO use type info if provided
-            ir_register.back()[entry->dest.value] = IRValue{IRValueType::immediate, result};
-            break;
+            HANDLER(br) {
+                pc = code->x;
+                NEXT();
+            }
+            HANDLER(brz) {
+                pc = reg(code->a) == 0 ? code->x : code->y;
+                NEXT();
+            }
+            HANDLER(brnz) {
+                pc = reg(code->a) != 0 ? code->x : code->y;
+                NEXT();
+            }
+            HANDLER(phi) {
+                assert(false);  // the decoder turns phis into copies on their incoming edges
+                NEXT();
+            }
+            HANDLER(dup) {
+                reg(code->dest) = reg(code->a);
+                NEXT();
+            }
+            HANDLER(index) {
+                auto* ptr = reinterpret_cast<i8*>(reg(code->a));
+                ptr += reg(code->b);
+                reg(code->dest) = (i64)(uintptr_t)ptr;
+                NEXT();
+            }
+            ARCVM_BIN_OPS(GENERIC_BIN_OP_HANDLER)
+            ARCVM_BIN_OPS(TYPED_BIN_OP_HANDLERS)
+            HANDLER(neg) {
+                reg(code->dest) = -reg(code->a);    // TODO use type info if provided
+                NEXT();
+            }
+            ARCVM_CMP_OPS(CMP_BRANCH_HANDLER)
+            ARCVM_MEMORY_TYPES(TYPED_LOAD_HANDLER, load)
+            ARCVM_MEMORY_TYPES(TYPED_STORE_HANDLER, store)
+            HANDLER(count) {
+                ++profile_counts[code->x];
+                NEXT();
+            }
+            // with tiering on, every loop iteration counts towards its function getting compiled
+            HANDLER(br_back) {
+                pc = code->x;
+                if(tiering)
+                    count_backedge(function);
+                NEXT();
+            }
+            ARCVM_MEMORY_TYPES(TYPED_ALLOC_STORE_HANDLER, alloc_store)
+            ARCVM_MEMORY_TYPES(TYPED_INC_MEM_HANDLER, inc_mem)
+            ARCVM_BIN_OPS(TYPED_LOAD_OP_STORE_HANDLERS)
+#ifndef ARCVM_COMPUTED_GOTO
+            default:
+                assert(false);
+                return IRValue{};
+#endif
         }
-        default:
-            assert(false);
-            return IRValue{};
     }
-    return IRValue{};
 }
 
-i64 IRInterpreter::unpack(IRValue value) {
-    if(value.type == IRValueType::reference)
-        return ir_register.back()[value.value].value;
-    else if(value.type == IRValueType::immediate)
-        return value.value;
-    else
-        assert(false);
-    return -1;
-}
\ No newline at end of file
+#ifdef ARCVM_COMPUTED_GOTO
+    #pragma GCC diagnostic pop
+#endif
@@ -50,6 +50,8 @@ void IRPrinter::print(std::vector<Attribute>& attributes, i32 indent) {
 
 void IRPrinter::print(Block* block, i32& var_name, i32 indent) {
     ARCVM_PROFILE();
+    // blocks that are still pending only get their place in blocks once compacted
+    block->compact();
     for (auto basic_block : block->blocks) {
         IRPrinter::print(basic_block, var_name, indent);
     }
@@ -61,8 +63,9 @@ void IRPrinter::print(BasicBlock* basic_block, i32& var_name, i32 indent) {
 
     print_indent();
     std::cout << '#' << basic_block->label.name << '\n';
-    for (auto entry : basic_block->entries) {
-        IRPrinter::print(entry, var_name, indent + 2);
+    for (size_t i = 0; i < basic_block->entries().size(); ++i) {
+        if(!basic_block->is_removed(i))
+            IRPrinter::print(basic_block->entries()[i], var_name, indent + 2);
     }
 }
 
@@ -71,19 +74,19 @@ void IRPrinter::print(Entry* entry, i32& var_name, i32 indent) {
     auto print_indent = [=]() { std::cout << std::string(indent, ' '); };
 
     print_indent();
-    if(entry->dest.type != IRValueType::none)
+    if(entry->dest().type != IRValueType::none)
         std::cout << '%' << var_name++ << " = ";
-    std::cout << to_string(entry->instruction) << ' ';
+    std::cout << to_string(entry->instruction()) << ' ';
 
-    for(size_t i = 0; i < entry->arguments.size() - 1; ++i) {
-        IRPrinter::print(&entry->arguments[i]);
+    for(size_t i = 0; i < entry->arguments().size() - 1; ++i) {
+        IRPrinter::print(&entry->arguments()[i]);
         std::cout << ", ";
     }
-    IRPrinter::print(&entry->arguments.back());
+    IRPrinter::print(&entry->arguments().back());
     std::cout << '\n';
 }
 
-void IRPrinter::print(IRValue* value, i32 indent) {
+void IRPrinter::print(IRValue const* value, i32 indent) {
     ARCVM_PROFILE();
     switch(value->type) {
         case IRValueType::none:
@@ -100,10 +103,10 @@ void IRPrinter::print(IRValue* value, i32 indent) {
             std::cout << to_string(value->type_value);
             break;
         case IRValueType::label:
-            std::cout << "#" << *(value->str_value);
+            std::cout << "#" << value->name();
             break;
         case IRValueType::fn_name:
-            std::cout << "@" << *(value->str_value);
+            std::cout << "@" << value->name();
             break;
         default:
             break;
@@ -7,20 +7,6 @@ using namespace arcvm;
 
 // could use a CFG but these are so trivial is doesn't matter
 
-static bool is_control_flow(Instruction inst) {
-    ARCVM_PROFILE();
-    switch(inst) {
-        case Instruction::br:
-        case Instruction::brz:
-        case Instruction::brnz:
-        case Instruction::call:
-        case Instruction::ret:
-            return true;
-        default:
-            return false;
-    }
-}
-
 static bool is_terminating_control_flow(Instruction inst) {
     ARCVM_PROFILE();
     switch(inst) {
@@ -61,27 +47,23 @@ void CFResolutionPass::process_block(Block* block) {
 
 void CFResolutionPass::remove_dead_br(BasicBlock* bb) {
     ARCVM_PROFILE();
-    if(bb->entries.size() <= 1) // not our job to handle this
+    auto& instructions = bb->instructions;
+    if(instructions.size() <= 1) // not our job to handle this
         return;
-    for(int i = 0; i < bb->entries.size(); ++i) {
-        if(i + 1 == bb->entries.size() &&
-               bb->entries[i]->instruction == Instruction::br &&
-               bb->entries[i-1]->instruction == Instruction::ret) {
-            bb->entries.erase(bb->entries.begin() + i);
-        }
+    auto last = instructions.size() - 1;
+    if(instructions[last] == Instruction::br && instructions[last - 1] == Instruction::ret) {
+        bb->remove_entry(last);
+        bb->compact();
     }
 }
 
 
 void CFResolutionPass::add_explicit_fallthrough(BasicBlock* current, BasicBlock* next) {
     ARCVM_PROFILE();
-    if(next && current->entries.empty()) {
-        current->gen_inst(Instruction::br, {IRValue{IRValueType::label, new std::string(next->label.name)}});
+    if(next && current->instructions.empty()) {
+        current->gen_inst(Instruction::br, {next->label_value()});
         return;
     }
-    for(int i = 0; i < current->entries.size(); ++i) {
-        if(i + 1 == current->entries.size() && !is_terminating_control_flow(current->entries[i]->instruction)) {
-            current->gen_inst(Instruction::br, {IRValue{IRValueType::label, new std::string(next->label.name)}});
-        }
-    }
+    if(!current->instructions.empty() && !is_terminating_control_flow(current->instructions.back()))
+        current->gen_inst(Instruction::br, {next->label_value()});
 }
\ No newline at end of file
@@ -4,59 +4,6 @@
 
 using namespace arcvm;
 
-// TODO I stole this from IRInterpreter
-// it should be moved into a function and cleaned up in general
-// NOTE this version is slightly modified
-#define CP_CAST_IF_TYPED_BIN_OP() do {                                             \
-                                   if(entry->arguments.size() == 3)                \
-                                       switch(entry->arguments[2].type_value) {    \
-                                           case Type::ir_b1:                       \
-                                           case Type::ir_b8:                       \
-                                           case Type::ir_i8:                       \
-                                               result = (i8)result;    \
-                                               break;                              \
-                                           case Type::ir_u8:                       \
-                                               result = (u8)result;    \
-                                               break;                              \
-                                           case Type::ir_i16:                      \
-                                               result = (i16)result;   \
-                                               break;                              \
-                                           case Type::ir_u16:                      \
-                                               result = (u16)result;   \
-                                               break;                              \
-                                           case Type::ir_i32:                      \
-                                               result = (i32)result;   \
-                                               break;                              \
-                                           case Type::ir_u32:                      \
-                                               result = (u32)result;   \
-                                               break;                              \
-                                           case Type::ir_i64:                      \
-                                               result = (i64)result;   \
-                                               break;                              \
-                                           case Type::ir_u64:                      \
-                                               result = (u64)result;   \
-                                               break;                              \
-                                           default:                                \
-                                               assert(false);                      \
-                                       }                                           \
-                               } while(false)    
-
-#define CP_BIN_OP(op)                                                                                                   \
-                    auto lhs = entry->arguments[0];                                                                     \
-                    auto rhs = entry->arguments[1];                                                                     \
-                    i64 result;                                                                                         \
-                                                                                                                        \
-                    if(isImmediate(lhs) && isImmediate(rhs))                                                            \
-                        result = lhs.value op rhs.value;                                                                \
-                    else {                                                                                              \
-                        continue;                                                                                       \
-                    }                                                                                                   \
-                    CP_CAST_IF_TYPED_BIN_OP();                                                                          \
-                    ir_registers[entry->dest.value] = WrappedIRValue{IRValue{IRValueType::immediate, result}, true};    \
-                    remove_entry(bblock->entries, i);                                                                   \
-                    i -= 1
-
-
 void ConstantPropogation::module_pass(Module* module) {
     ARCVM_PROFILE();
     for(auto* fn : module->functions) {
@@ -69,149 +16,69 @@ void ConstantPropogation::process_function(Function* function) {
     process_block(function->block);
 }
 
+// every entry starts on the worklist, an entry that folds to a constant has that constant
+// written into each of its uses and those users go back on the worklist, so each entry
+// is revisited at most once per argument that became a constant
+// folded entries are only marked and get removed from their blocks in one pass at the end
 void ConstantPropogation::process_block(Block* block) {
     ARCVM_PROFILE();
-    for(auto* bblock : block->blocks) {
-        propogate_constants(bblock);
+    std::vector<Entry*> worklist;
+    for(auto* bblock : block->blocks)
+        for(size_t i = 0; i < bblock->entries().size(); ++i)
+            if(!bblock->is_removed(i))
+                worklist.push_back(bblock->entries()[i]);
+    std::vector<bool> folded(block->var_name, false);
+
+    while(!worklist.empty()) {
+        auto* entry = worklist.back();
+        worklist.pop_back();
+        if(entry->dest().type == IRValueType::none || folded[entry->dest().value])
+            continue;
+        auto constant = fold(entry);
+        if(!constant)
+            continue;
+        folded[entry->dest().value] = true;
+        block->replace_all_uses(entry->dest().value, IRValue{IRValueType::immediate, *constant},
+                                [&](Entry* user) { worklist.push_back(user); });
     }
+
+    for(auto* bblock : block->blocks)
+        bblock->remove_entries_if([&](Entry* entry) {
+            return entry->dest().type != IRValueType::none && folded[entry->dest().value];
+        });
 }
 
-void ConstantPropogation::propogate_constants(BasicBlock* bblock) {
-    ARCVM_PROFILE();
-    std::array<WrappedIRValue, 100> ir_registers;
-    // for(auto* entry : bblock->entries) {
-    for(int i = 0; i < bblock->entries.size(); ++i) {
-        auto* entry = bblock->entries[i];
-        for(int x = 0; x < entry->arguments.size(); ++x) {
-            auto& arg = entry->arguments[x];
-            if(isReference(arg) && isConstant(ir_registers[arg.value]) && isValidValue(ir_registers[arg.value])) {
-                entry->arguments[x] = IRValue{IRValueType::immediate, ir_registers[entry->arguments[x].value].value.value};
-            }
-        }
-        switch (entry->instruction) {
-            case Instruction::alloc: {
-                // TODO
-                break;
-            }
-            case Instruction::load: {
-                // TODO
-                break;
-            }
-            case Instruction::store: {
-                // TODO
-                break;
-            }
-            case Instruction::call: {
-                // TODO
-                break;
-            }
-            case Instruction::ret: {
-                // TODO
-                break;
-            }
-            case Instruction::br: {
-                // TODO
-                break;
-            }
-            case Instruction::brz: {
-                // TODO
-                break;
-            }
-            case Instruction::brnz: {
-                // TODO
-                break;
-            }
-            case Instruction::phi: {
-                // TODO
-                break;
-            }
-            case Instruction::dup: {
-                auto arg = entry->arguments[0];
-                if(isImmediate(arg))
-                    ir_registers[entry->dest.value] = {arg, true};
-                else if(isReference(arg) && isConstant(ir_registers[arg.value]))
-                    ir_registers[entry->dest.value] = {ir_registers[arg.value].value, true};
-                else
-                    continue;
-                remove_entry(bblock->entries, i);
-                i -= 1;
-                break;
-            }
-            case Instruction::index: {
-                // TODO
-                break;
-            }
-            case Instruction::add: {
-                CP_BIN_OP(+);
-                break;
-            }
-            case Instruction::sub: {
-                CP_BIN_OP(-);
-                break;
-            }
-            case Instruction::mul: {
-                CP_BIN_OP(*);
-                break;
-            }
-            case Instruction::div: {
-                CP_BIN_OP(/);
-                break;
-            }
-            case Instruction::mod: {
-                CP_BIN_OP(%);
-                break;
-            }
-            case Instruction::bin_or: {
-                CP_BIN_OP(|);
-                break;
-            }
-            case Instruction::bin_and: {
-                CP_BIN_OP(&);
-                break;
-            }
-            case Instruction::bin_xor: {
-                CP_BIN_OP(^);
-                break;
-            }
-            case Instruction::lshift: {
-                CP_BIN_OP(<<);
-                break;
-            }
-            case Instruction::rshift: {
-                CP_BIN_OP(>>);
-                break;
-            }
-            case Instruction::lt: {
-                CP_BIN_OP(<);
-                break;
-            }
-            case Instruction::gt: {
-                CP_BIN_OP(>);
-                break;
-            }
-            case Instruction::lte: {
-                CP_BIN_OP(<=);
-                break;
-            }
-            case Instruction::gte: {
-                CP_BIN_OP(>=);
-                break;
-            }
-            case Instruction::eq: {
-                CP_BIN_OP(==);
-                break;
-            }
-            case Instruction::neq: {
-                CP_BIN_OP(-);
-                break;
-            }
-            case Instruction::neg: {
-                // auto result = -ir_register.back()[entry->arguments[0].value].value;
-                // ir_register.back()[entry->dest.value] = IRValue{IRValueType::immediate, result};
-                break;
-            }
-            default:
-                assert(false);
+// folding goes through the same templates as the interpreter's handlers
+std::optional<i64> ConstantPropogation::fold(Entry* entry) {
+    auto args = entry->arguments();
+    switch (entry->instruction()) {
+        case Instruction::dup:
+            if(isImmediate(args[0]))
+                return args[0].value;
+            return std::nullopt;
+        case Instruction::add:
+        case Instruction::sub:
+        case Instruction::mul:
+        case Instruction::div:
+        case Instruction::mod:
+        case Instruction::bin_or:
+        case Instruction::bin_and:
+        case Instruction::bin_xor:
+        case Instruction::lshift:
+        case Instruction::rshift:
+        case Instruction::lt:
+        case Instruction::gt:
+        case Instruction::lte:
+        case Instruction::gte:
+        case Instruction::eq:
+        case Instruction::neq: {
+            if(!isImmediate(args[0]) || !isImmediate(args[1]))
+                return std::nullopt;
+            auto type = args.size() == 3 ? args[2].type_value : Type::none;
+            return fold_bin_op(entry->instruction(), type, args[0].value, args[1].value);
         }
+        // TODO neg, and loads of memory nothing else stored to
+        default:
+            return std::nullopt;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,94 @@
+#include "Passes/PurityAnalysis.h"
+
+#include <algorithm>
+#include <unordered_set>
+
+using namespace arcvm;
+
+// every function that passes the local checks starts out pure, then anything calling
+// a function that isn't is removed until nothing changes, so recursion stays pure
+void PurityAnalysis::module_pass(Module* module) {
+    ARCVM_PROFILE();
+    // indexed by the Symbol::id of a function's name
+    std::vector<Symbol const*> names;
+    for(auto* fn : module->functions)
+        names.push_back(module->symbols.intern(fn->name));
+    std::vector<bool> pure(module->symbols.size(), false);
+    for(size_t i = 0; i < names.size(); ++i)
+        pure[names[i]->id] = is_candidate(module->functions[i]);
+
+    bool changed = true;
+    while(changed) {
+        changed = false;
+        for(size_t i = 0; i < names.size(); ++i) {
+            if(pure[names[i]->id] && !calls_only(module->functions[i], pure)) {
+                pure[names[i]->id] = false;
+                changed = true;
+            }
+        }
+    }
+
+    for(size_t i = 0; i < names.size(); ++i) {
+        auto* fn = module->functions[i];
+        if(!pure[names[i]->id])
+            continue;
+        if(std::find(fn->attributes.begin(), fn->attributes.end(), Attribute::pure) == fn->attributes.end())
+            fn->add_attribute(Attribute::pure);
+    }
+}
+
+// loads, stores and indexing have to go through pointers the function got from its own allocs
+// values are visited in block order so a pointer used before its alloc is seen counts as foreign
+bool PurityAnalysis::is_candidate(Function* function) {
+    ARCVM_PROFILE();
+    if(function->return_type == Type::none)
+        return false;
+    for(auto attribute : function->attributes)
+        if(attribute == Attribute::entrypoint)
+            return false;
+
+    std::unordered_set<i64> local;
+    auto is_local = [&](IRValue const& value) {
+        return (value.type == IRValueType::reference || value.type == IRValueType::pointer) && local.contains(value.value);
+    };
+    for(auto* bblock : function->block->blocks) {
+        for(size_t i = 0; i < bblock->entries().size(); ++i) {
+            if(bblock->is_removed(i))
+                continue;
+            auto* entry = bblock->entries()[i];
+            auto args = entry->arguments();
+            switch(entry->instruction()) {
+                case Instruction::alloc:
+                    local.insert(entry->dest().value);
+                    break;
+                case Instruction::load:
+                case Instruction::store:
+                    if(!is_local(args[0]))
+                        return false;
+                    break;
+                case Instruction::index:
+                    if(!is_local(args[0]))
+                        return false;
+                    local.insert(entry->dest().value);
+                    break;
+                case Instruction::dup:
+                    if(is_local(args[0]))
+                        local.insert(entry->dest().value);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    return true;
+}
+
+bool PurityAnalysis::calls_only(Function* function, std::vector<bool> const& callees) {
+    ARCVM_PROFILE();
+    for(auto* bblock : function->block->blocks)
+        for(size_t i = 0; i < bblock->entries().size(); ++i)
+            if(!bblock->is_removed(i) && bblock->entries()[i]->instruction() == Instruction::call
+               && !callees[bblock->entries()[i]->arguments()[0].symbol->id])
+                return false;
+    return true;
+}
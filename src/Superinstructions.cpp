@@ -0,0 +1,190 @@
+#include "Superinstructions.h"
+
+using namespace arcvm;
+
+namespace {
+
+// a pattern of length ops that match accepts, uses counts the reads of every register
+// fusing can only drop a result if the fused ops were the only ones reading it
+struct Fusion {
+    i32 length;
+    bool (*match)(Op const*, std::vector<i32> const& uses);
+    Op (*fuse)(Op const*);
+};
+
+bool is_cmp(OpCode opcode) {
+    if(!is_typed_bin_op(opcode))
+        return false;
+    auto instruction = typed_opcode_instruction(opcode);
+    return instruction >= Instruction::lt && instruction <= Instruction::neq;
+}
+
+bool reads(OperandKind kind, i64 value, i32 slot) {
+    return kind == OperandKind::reg && value == slot;
+}
+
+// the op truncates to at least as many bytes as the memory holds, so it can't change what gets stored
+bool fits_memory(Type op_type, Type memory_type) {
+    auto op_size = op_type == Type::none ? 8 : type_size(op_type);
+    auto memory_size = memory_type == Type::none ? 8 : type_size(memory_type);
+    return op_size >= memory_size;
+}
+
+// lt t, a, b; brnz t, x, y  ->  br_lt a, b, x, y
+bool match_cmp_branch(Op const* ops, std::vector<i32> const& uses) {
+    return is_cmp(ops[0].opcode) &&
+        (ops[1].opcode == OpCode::brz || ops[1].opcode == OpCode::brnz) &&
+        reads(ops[1].a_kind, ops[1].a, ops[0].dest) && uses[ops[0].dest] == 1;
+}
+
+// comparisons are 0 or 1 so the type they truncate to never matters
+Op fuse_cmp_branch(Op const* ops) {
+    auto instruction = typed_opcode_instruction(ops[0].opcode);
+    Op op = ops[0];
+    op.opcode = static_cast<OpCode>((i32)OpCode::br_lt + (i32)instruction - (i32)Instruction::lt);
+    op.dest = -1;
+    op.x = ops[1].x;
+    op.y = ops[1].y;
+    if(ops[1].opcode == OpCode::brz)
+        std::swap(op.x, op.y);
+    return op;
+}
+
+// alloc p; store p, v  ->  alloc_store_<width> p, v
+bool match_alloc_store(Op const* ops, std::vector<i32> const&) {
+    return ops[0].opcode == OpCode::alloc && ops[1].opcode == OpCode::store &&
+        reads(ops[1].a_kind, ops[1].a, ops[0].dest);
+}
+
+Op fuse_alloc_store(Op const* ops) {
+    Op op = ops[1];
+    op.opcode = alloc_store_opcode(ops[1].type);
+    op.dest = ops[0].dest;
+    op.a_kind = OperandKind::none;
+    op.a = 0;
+    op.x = type_size(ops[0].type);
+    return op;
+}
+
+// load t, p; op u, t, b; store p, u  ->  load_<op>_store p, b
+bool match_load_op_store(Op const* ops, std::vector<i32> const& uses) {
+    auto const& load = ops[0];
+    auto const& bin_op = ops[1];
+    auto const& store = ops[2];
+    return load.opcode == OpCode::load && is_typed_bin_op(bin_op.opcode) && store.opcode == OpCode::store &&
+        reads(bin_op.a_kind, bin_op.a, load.dest) && uses[load.dest] == 1 &&
+        reads(store.b_kind, store.b, bin_op.dest) && uses[bin_op.dest] == 1 &&
+        store.a_kind == OperandKind::reg && store.a == load.a && store.type == load.type &&
+        fits_memory(bin_op.type, store.type);
+}
+
+Op fuse_load_op_store(Op const* ops) {
+    Op op = ops[2];
+    op.opcode = load_op_store_opcode(typed_opcode_instruction(ops[1].opcode), ops[2].type);
+    op.b_kind = ops[1].b_kind;
+    op.b = ops[1].b;
+    return op;
+}
+
+// load t, p; add u, t, imm; store p, u  ->  inc_mem_<width> p, imm
+bool match_inc_mem(Op const* ops, std::vector<i32> const& uses) {
+    if(!match_load_op_store(ops, uses) || ops[1].b_kind != OperandKind::imm)
+        return false;
+    auto instruction = typed_opcode_instruction(ops[1].opcode);
+    return instruction == Instruction::add || instruction == Instruction::sub;
+}
+
+Op fuse_inc_mem(Op const* ops) {
+    Op op = fuse_load_op_store(ops);
+    op.opcode = inc_mem_opcode(ops[2].type);
+    if(typed_opcode_instruction(ops[1].opcode) == Instruction::sub)
+        op.b = -op.b;
+    return op;
+}
+
+// call t, f; ret t  ->  tail_call f
+bool match_tail_call(Op const* ops, std::vector<i32> const& uses) {
+    return ops[0].opcode == OpCode::call && ops[1].opcode == OpCode::ret &&
+        reads(ops[1].a_kind, ops[1].a, ops[0].dest) && uses[ops[0].dest] == 1;
+}
+
+Op fuse_tail_call(Op const* ops) {
+    Op op = ops[0];
+    op.opcode = OpCode::tail_call;
+    op.dest = -1;
+    return op;
+}
+
+// tried in order at every op, so a pattern has to come before any pattern it is a special case of
+constexpr Fusion fusions[] = {
+    {3, match_inc_mem, fuse_inc_mem},
+    {3, match_load_op_store, fuse_load_op_store},
+    {2, match_cmp_branch, fuse_cmp_branch},
+    {2, match_alloc_store, fuse_alloc_store},
+    {2, match_tail_call, fuse_tail_call},
+};
+
+}
+
+// runs after branch targets are offsets, a pattern never spans the start of a block
+// since something else may jump into the middle of it
+void arcvm::fuse_superinstructions(BytecodeFunction& function) {
+    ARCVM_PROFILE();
+    auto& code = function.code;
+
+    std::vector<i32> uses(function.register_count, 0);
+    auto count_use = [&](OperandKind kind, i64 value) {
+        if(kind == OperandKind::reg)
+            ++uses[value];
+    };
+    for(auto const& op : code) {
+        count_use(op.a_kind, op.a);
+        count_use(op.b_kind, op.b);
+    }
+    for(auto const& operand : function.operand_pool)
+        count_use(operand.kind, operand.value);
+
+    std::vector<bool> block_starts(code.size() + 1, false);
+    for(auto offset : function.block_offsets)
+        block_starts[offset] = true;
+    auto fits_in_block = [&](size_t start, i32 length) {
+        if(start + length > code.size())
+            return false;
+        for(size_t i = start + 1; i < start + length; ++i)
+            if(block_starts[i])
+                return false;
+        return true;
+    };
+
+    std::vector<Op> fused;
+    std::vector<i32> new_offsets(code.size() + 1, -1);
+    for(size_t i = 0; i < code.size();) {
+        new_offsets[i] = (i32)fused.size();
+        Fusion const* match = nullptr;
+        for(auto const& fusion : fusions) {
+            if(fits_in_block(i, fusion.length) && fusion.match(&code[i], uses)) {
+                match = &fusion;
+                break;
+            }
+        }
+        if(match) {
+            fused.push_back(match->fuse(&code[i]));
+            i += match->length;
+        }
+        else {
+            fused.push_back(code[i++]);
+        }
+    }
+    new_offsets[code.size()] = (i32)fused.size();
+
+    for(auto& offset : function.block_offsets)
+        offset = new_offsets[offset];
+    for(auto& op : fused) {
+        if(!is_branch(op.opcode))
+            continue;
+        op.x = new_offsets[op.x];
+        if(!is_unconditional_branch(op.opcode))
+            op.y = new_offsets[op.y];
+    }
+    code = std::move(fused);
+}
@@ -52,82 +52,127 @@ i32 x86_64_Backend::run() {
     return ret;
 }
 
-void x86_64_Backend::compile_module(Module* module) {
+x86_64_Backend::~x86_64_Backend() {
+    for(auto [block, size] : native_blocks)
+        dealloc(block, size);
+}
+
+// lowers the function into its own executable block, or gives up with nullptr on the first entry
+// compile_entry can't lower. that is any branch or call and any use of a parameter for now
+// so only straight-line functions that ignore their arguments ever compile
+NativeFunction x86_64_Backend::compile_native(Function* function) {
+    ARCVM_PROFILE();
+    output.clear();
+    val_table.fill(x86_64::Value{});
+    free_volatile_registers = abi.volatile_register_list();
+    free_nonvolatile_registers = abi.nonvolatile_register_list();
+    if(!compile_function(function))
+        return nullptr;
+
+    void* block = alloc_memory(output.size());
+    if(!block)
+        return nullptr;
+    memcpy(block, output.data(), output.size());
+    native_blocks.emplace_back(block, output.size());
+    return (NativeFunction)make_executable(block);
+}
+
+bool x86_64_Backend::compile_module(Module* module) {
     ARCVM_PROFILE();
     for (auto* function : module->functions)
-        compile_function(function);
+        if(!compile_function(function))
+            return false;
 
     std::cout << std::hex;
     for(byte b: output)
         std::cout << std::setw(2) << std::setfill('0') << (int)b << " ";
     std::cout << std::dec << "\n";
+    return true;
 }
 
-void x86_64_Backend::compile_function(Function* function) {
+bool x86_64_Backend::compile_function(Function* function) {
     ARCVM_PROFILE();
     disp_list.emplace_back(0);
-    compile_block(function->block);
+    auto lowered = compile_block(function->block);
     disp_list.pop_back();
+    return lowered;
 }
 
-void x86_64_Backend::compile_block(Block* block) {
+bool x86_64_Backend::compile_block(Block* block) {
     ARCVM_PROFILE();
+    // pending blocks aren't in blocks and removed entries still are until it's compacted
+    block->compact();
     for(auto* basicblock : block->blocks)
-        compile_basicblock(basicblock);
+        if(!compile_basicblock(basicblock))
+            return false;
+    return true;
 }
 
-void x86_64_Backend::compile_basicblock(BasicBlock* basicblock) {
+bool x86_64_Backend::compile_basicblock(BasicBlock* basicblock) {
     ARCVM_PROFILE();
-    for(auto* entry : basicblock->entries)
-        compile_entry(entry);
-}
-
-// TODO make this void? I don't remember why it returns an int
-int x86_64_Backend::compile_entry(Entry* entry) {
-    switch (entry->instruction) {
+    for(size_t i = 0; i < basicblock->entries().size(); ++i)
+        if(!basicblock->is_removed(i) && !compile_entry(basicblock->entries()[i]))
+            return false;
+    return true;
+}
+
+// false if the entry can't be lowered yet, the output is unusable from then on
+// compile_native relies on this being the only check of what the backend handles
+bool x86_64_Backend::compile_entry(Entry* entry) {
+    if(entry->dest().type != IRValueType::none && entry->dest().value >= (i64)val_table.size())
+        return false;
+    // a value from an entry that was lowered, parameters never are
+    auto known = [&](IRValue value, ValueType type) {
+        return value.type == IRValueType::reference && value.value < (i64)val_table.size() &&
+               val_table[value.value].type == type;
+    };
+    switch (entry->instruction()) {
         case Instruction::alloc: {
-            auto size = type_size(entry->arguments[0].type_value);
+            auto size = type_size(entry->arguments()[0].type_value);
             auto disp = -size + local_disp;
             local_disp = disp;
 
-            val_table[entry->dest.value] = Value{disp};
+            val_table[entry->dest().value] = Value{disp};
             i8 num_bits = size * 8;
             // TODO maybe take an option to zero intialize??
             // emit_mov(D(disp), I(0), num_bits);
             break;
         }
         case Instruction::load: {
-            auto val = val_table[entry->arguments[0].value];
-
-            assert(val.type != REGISTER);
+            if(!known(entry->arguments()[0], DISPLACEMENT) || free_volatile_registers.empty())
+                return false;
+            auto val = val_table[entry->arguments()[0].value];
 
             i32 size = 8;
-            if(entry->arguments.size() > 1) {
-                size = type_size(entry->arguments[1].type_value);
+            if(entry->arguments().size() > 1) {
+                size = type_size(entry->arguments()[1].type_value);
             }
 
             i8 num_bits = size * 8;
 
             auto reg = Register{get_fvr(), num_bits};
             emit_mov(reg, D(val.disp), num_bits);
-            val_table[entry->dest.value] = reg;
+            val_table[entry->dest().value] = reg;
             break;
         }
         case Instruction::store: {
+            if(!known(entry->arguments()[0], DISPLACEMENT))
+                return false;
 
             Value val;
-            if (entry->arguments[1].type == IRValueType::immediate) {
-                val = Value{IMMEDIATE, i32(entry->arguments[1].value)};
-            } else if (entry->arguments[1].type == IRValueType::reference) {
-                val = val_table[entry->arguments[1].value];
-            }
+            if (entry->arguments()[1].type == IRValueType::immediate) {
+                val = Value{IMMEDIATE, i32(entry->arguments()[1].value)};
+            } else if (known(entry->arguments()[1], REGISTER)) {
+                val = val_table[entry->arguments()[1].value];
+            } else
+                return false;
 
             i32 size = 8;
-            if(entry->arguments.size() > 2) {
-                size = type_size(entry->arguments[2].type_value);
+            if(entry->arguments().size() > 2) {
+                size = type_size(entry->arguments()[2].type_value);
             }
 
-            auto disp = val_table[entry->arguments[0].value].disp;
+            auto disp = val_table[entry->arguments()[0].value].disp;
             i8 num_bits = size * 8;
 
             if(val.type == REGISTER)
@@ -137,15 +182,14 @@ int x86_64_Backend::compile_entry(Entry* entry) {
 
             break;
         }
-        case Instruction::call: {
-            break;
-        }
         case Instruction::ret: {
+            if(entry->arguments().empty())
+                return false;
             Value val;
-            if(entry->arguments[0].type == IRValueType::reference)
-                val = val_table[entry->arguments[0].value];
-            else if(entry->arguments[0].type == IRValueType::immediate)
-                val = Value{IMMEDIATE, i32(entry->arguments[0].value)};
+            if(entry->arguments()[0].type == IRValueType::reference)
+                val = val_table[entry->arguments()[0].value];
+            else if(entry->arguments()[0].type == IRValueType::immediate)
+                val = Value{IMMEDIATE, i32(entry->arguments()[0].value)};
 
             // TODO keep type info around so it can be used here
             switch(val.type) {
@@ -153,61 +197,54 @@ int x86_64_Backend::compile_entry(Entry* entry) {
                     emit_mov(Register{rax}, D(val.disp), 64);
                     break;
                 case REGISTER:
+                    // there is no sign extending mov yet, a narrower value would come back zero extended
+                    if(calc_op_size(val.reg) != 64)
+                        return false;
                     if(val.reg.name != RegisterName::rax)
-                        emit_mov(Register{rax}, val.reg, calc_op_size(val.reg));
+                        emit_mov(Register{rax}, val.reg, 64);
                     break;
                 case IMMEDIATE:
                     emit_mov(Register{rax}, I(val.imm), 64); // need type info
                     break;
                 default:
-                    assert(false);
+                    return false;
             }
 
             emit_ret();
             break;
         }
-        case Instruction::br: {
-            break;
-        }
-        case Instruction::brz: {
-            break;
-        }
-        case Instruction::brnz: {
-            break;
-        }
-        case Instruction::phi: {
-            break;
-        }
         case Instruction::dup: {
-            if(entry->arguments[0].type == IRValueType::reference)
-                val_table[entry->dest.value] = val_table[entry->arguments[0].value];
-            else if(entry->arguments[0].type == IRValueType::immediate) {
-                auto imm  = I(entry->arguments[0].value);
+            if(entry->arguments()[0].type == IRValueType::reference) {
+                if(entry->arguments()[0].value >= (i64)val_table.size() || val_table[entry->arguments()[0].value].type == NONE)
+                    return false;
+                val_table[entry->dest().value] = val_table[entry->arguments()[0].value];
+            }
+            else if(entry->arguments()[0].type == IRValueType::immediate && !free_volatile_registers.empty()) {
+                auto imm  = I(entry->arguments()[0].value);
                 // TODO use type info or calcualte smallest bit width
                 i8 num_bits = 64;
                 auto reg = Register{get_fvr(), num_bits};
                 emit_mov(reg, imm, num_bits);
-                val_table[entry->dest.value] = reg;
+                val_table[entry->dest().value] = reg;
             }
             else
-                assert(false);
-            break;
-        }
-        case Instruction::index: {
+                return false;
             break;
         }
         case Instruction::add: {
             Value dest;
-            if(entry->arguments[0].type == IRValueType::reference) {
-                dest = val_table[entry->arguments[0].value];
+            if(known(entry->arguments()[0], REGISTER)) {
+                dest = val_table[entry->arguments()[0].value];
             }
             else {
-                assert(false);
+                return false;
             }
 
             Value src;
-            if(entry->arguments[1].type == IRValueType::reference) {
-                src = val_table[entry->arguments[1].value];
+            if(known(entry->arguments()[1], REGISTER)) {
+                src = val_table[entry->arguments()[1].value];
+                if(src.reg.name == dest.reg.name)
+                    return false;
                 auto size = calc_op_size(dest.reg, src.reg);
                 emit_add(dest.reg, src.reg, size);
 
@@ -215,29 +252,31 @@ int x86_64_Backend::compile_entry(Entry* entry) {
                 //put_fvr(dest.reg.name);
                 put_fvr(src.reg.name);
             }
-            else if(entry->arguments[1].type == IRValueType::immediate) {
-                src = static_cast<i32>(entry->arguments[1].value);
+            else if(entry->arguments()[1].type == IRValueType::immediate) {
+                src = static_cast<i32>(entry->arguments()[1].value);
                 emit_add(dest.reg, I(src.imm), 32);    // TODO need to keep size metadata with imm
 
                 // TODO waiting for register allocator
                 //put_fvr(dest.reg.name);
             }
             else
-                assert(false);
+                return false;
 
-            val_table[entry->dest.value] = dest.reg;
+            val_table[entry->dest().value] = dest.reg;
             break;
         }
         case Instruction::sub: {
             Value dest;
-            if(entry->arguments[0].type == IRValueType::reference)
-                dest = val_table[entry->arguments[0].value];
-            else     // immediate
-                assert(false);
+            if(known(entry->arguments()[0], REGISTER))
+                dest = val_table[entry->arguments()[0].value];
+            else
+                return false;
 
             Value src;
-            if(entry->arguments[1].type == IRValueType::reference) {
-                src = val_table[entry->arguments[1].value];
+            if(known(entry->arguments()[1], REGISTER)) {
+                src = val_table[entry->arguments()[1].value];
+                if(src.reg.name == dest.reg.name)
+                    return false;
                 auto size = calc_op_size(dest.reg, src.reg);
 
                 emit_sub(dest.reg, src.reg, size);
@@ -245,32 +284,34 @@ int x86_64_Backend::compile_entry(Entry* entry) {
                 //put_fvr(dest.reg.name);
                 put_fvr(src.reg.name);
             }
-            else {    // immediate
-                src = entry->arguments[1].value;
+            else if(entry->arguments()[1].type == IRValueType::immediate) {
+                src = entry->arguments()[1].value;
                 auto size = calc_op_size(dest.reg);
 
                 emit_sub(dest.reg, I(src.imm), size);
                 // TODO waiting for register allocator
                 //put_fvr(dest.reg.name);
             }
+            else
+                return false;
 
-            val_table[entry->dest.value] = dest.reg;
+            val_table[entry->dest().value] = dest.reg;
             break;
         }
         case Instruction::mul: {
             Value dest;
-            if(entry->arguments[0].type == IRValueType::reference)
-                dest = val_table[entry->arguments[0].value];
-            else     // immediate
-                assert(false);
-            //dest = entry->arguments[0].value;
+            if(known(entry->arguments()[0], REGISTER))
+                dest = val_table[entry->arguments()[0].value];
+            else
+                return false;
+            //dest = entry->arguments()[0].value;
 
             Value src;
-            if(entry->arguments[1].type == IRValueType::reference)
-                src = val_table[entry->arguments[1].value];
-            else    // immediate
-                assert(false);
-            //src = entry->arguments[1].value;
+            if(known(entry->arguments()[1], REGISTER) && val_table[entry->arguments()[1].value].reg.name != dest.reg.name)
+                src = val_table[entry->arguments()[1].value];
+            else
+                return false;
+            //src = entry->arguments()[1].value;
 
             auto size = calc_op_size(dest.reg, src.reg);
 
@@ -280,29 +321,23 @@ int x86_64_Backend::compile_entry(Entry* entry) {
             //put_fvr(dest.reg.name);
             put_fvr(src.reg.name);
 
-            val_table[entry->dest.value] = dest.reg;
-            break;
-        }
-        case Instruction::div: {
-            break;
-        }
-        case Instruction::mod: {
+            val_table[entry->dest().value] = dest.reg;
             break;
         }
         case Instruction::bin_or: {
             Value dest;
-            if(entry->arguments[0].type == IRValueType::reference)
-                dest = val_table[entry->arguments[0].value];
-            else     // immediate
-                assert(false);
-            //dest = entry->arguments[0].value;
+            if(known(entry->arguments()[0], REGISTER))
+                dest = val_table[entry->arguments()[0].value];
+            else
+                return false;
+            //dest = entry->arguments()[0].value;
 
             Value src;
-            if(entry->arguments[1].type == IRValueType::reference)
-                src = val_table[entry->arguments[1].value];
-            else    // immediate
-                assert(false);
-            //src = entry->arguments[1].value;
+            if(known(entry->arguments()[1], REGISTER) && val_table[entry->arguments()[1].value].reg.name != dest.reg.name)
+                src = val_table[entry->arguments()[1].value];
+            else
+                return false;
+            //src = entry->arguments()[1].value;
 
             auto size = calc_op_size(dest.reg, src.reg);
 
@@ -312,23 +347,23 @@ int x86_64_Backend::compile_entry(Entry* entry) {
             //put_fvr(dest.reg.name);
             put_fvr(src.reg.name);
 
-            val_table[entry->dest.value] = dest.reg;
+            val_table[entry->dest().value] = dest.reg;
             break;
         }
         case Instruction::bin_and: {
             Value dest;
-            if(entry->arguments[0].type == IRValueType::reference)
-                dest = val_table[entry->arguments[0].value];
-            else     // immediate
-                assert(false);
-            //dest = entry->arguments[0].value;
+            if(known(entry->arguments()[0], REGISTER))
+                dest = val_table[entry->arguments()[0].value];
+            else
+                return false;
+            //dest = entry->arguments()[0].value;
 
             Value src;
-            if(entry->arguments[1].type == IRValueType::reference)
-                src = val_table[entry->arguments[1].value];
-            else    // immediate
-                assert(false);
-            //src = entry->arguments[1].value;
+            if(known(entry->arguments()[1], REGISTER) && val_table[entry->arguments()[1].value].reg.name != dest.reg.name)
+                src = val_table[entry->arguments()[1].value];
+            else
+                return false;
+            //src = entry->arguments()[1].value;
 
             auto size = calc_op_size(dest.reg, src.reg);
 
@@ -338,23 +373,23 @@ int x86_64_Backend::compile_entry(Entry* entry) {
             //put_fvr(dest.reg.name);
             put_fvr(src.reg.name);
 
-            val_table[entry->dest.value] = dest.reg;
+            val_table[entry->dest().value] = dest.reg;
             break;
         }
         case Instruction::bin_xor: {
             Value dest;
-            if(entry->arguments[0].type == IRValueType::reference)
-                dest = val_table[entry->arguments[0].value];
-            else     // immediate
-                assert(false);
-            //dest = entry->arguments[0].value;
+            if(known(entry->arguments()[0], REGISTER))
+                dest = val_table[entry->arguments()[0].value];
+            else
+                return false;
+            //dest = entry->arguments()[0].value;
 
             Value src;
-            if(entry->arguments[1].type == IRValueType::reference)
-                src = val_table[entry->arguments[1].value];
-            else    // immediate
-                assert(false);
-            //src = entry->arguments[1].value;
+            if(known(entry->arguments()[1], REGISTER) && val_table[entry->arguments()[1].value].reg.name != dest.reg.name)
+                src = val_table[entry->arguments()[1].value];
+            else
+                return false;
+            //src = entry->arguments()[1].value;
 
             auto size = calc_op_size(dest.reg, src.reg);
 
@@ -364,40 +399,16 @@ int x86_64_Backend::compile_entry(Entry* entry) {
             //put_fvr(dest.reg.name);
             put_fvr(src.reg.name);
 
-            val_table[entry->dest.value] = dest.reg;
-            break;
-        }
-        case Instruction::lshift: {
-            break;
-        }
-        case Instruction::rshift: {
-            break;
-        }
-        case Instruction::lt: {
-            break;
-        }
-        case Instruction::gt: {
-            break;
-        }
-        case Instruction::lte: {
-            break;
-        }
-        case Instruction::gte: {
-            break;
-        }
-        case Instruction::eq: {
-            break;
-        }
-        case Instruction::neq: {
+            val_table[entry->dest().value] = dest.reg;
             break;
         }
         case Instruction::neg: {
             Value dest;
-            if(entry->arguments[0].type == IRValueType::reference)
-                dest = val_table[entry->arguments[0].value];
-            else     // immediate
-                assert(false);
-            //dest = entry->arguments[0].value;
+            if(known(entry->arguments()[0], REGISTER))
+                dest = val_table[entry->arguments()[0].value];
+            else
+                return false;
+            //dest = entry->arguments()[0].value;
 
             auto size = calc_op_size(dest.reg);
 
@@ -406,13 +417,15 @@ int x86_64_Backend::compile_entry(Entry* entry) {
             // TODO waiting for register allocator
             //put_fvr(dest.reg.name);
 
-            val_table[entry->dest.value] = dest.reg;
+            val_table[entry->dest().value] = dest.reg;
             break;
         }
+        // calls, branches, phis, index, div, mod, shifts and comparisons
+        // with no calls there's no tail call to turn into a jmp either, that waits for calls
         default:
-            break;
+            return false;
     }
-    return 0;
+    return true;
 }
 
 void x86_64_Backend::emit_mov(Displacement disp, Immediate immediate, i8 size) {
@@ -1,10 +1,13 @@
 #include "Common.h"
 #include "IRGenerator.h"
 #include "IRInterpreter.h"
+#include "BatchInterpreter.h"
 #include "IRPrinter.h"
 #include "Arcvm.h"
 
 #include <mutex>
+#include <sstream>
+#include <thread>
 
 using namespace arcvm;
 
@@ -1017,6 +1020,27 @@ inline static bool gte_3() {
     return execute(vm) == 0;
 }
 
+// folded by ConstantPropogation, which has to agree with the interpreter
+inline static bool neq_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body = main->get_block();
+    auto* bblock = fn_body->get_bblock();
+    auto val = bblock->gen_inst(Instruction::dup, {IRValue{7}});
+    auto result = bblock->gen_inst(Instruction::neq, {val, IRValue{5}, IRValue{Type::ir_i32}});
+    bblock->gen_inst(Instruction::ret, {result});
+
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    return execute(vm) == 1;
+}
+
 inline static bool index_1() {
     ARCVM_PROFILE();
     IRGenerator gen;
@@ -1234,6 +1258,40 @@ inline static bool branch_2() {
 }
 
 
+// both functions get blocks named #0 and #1, branches have to stay inside their own function
+inline static bool branch_3() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body1 = main->get_block();
+    auto* bblock1 = fn_body1->get_bblock();
+    auto cond = bblock1->gen_inst(Instruction::dup, {IRValue{1}});
+    auto* if_block1 = fn_body1->new_basic_block();
+    auto* else_block1 = fn_body1->new_basic_block();
+    bblock1->gen_inst(Instruction::brnz, {cond, IRValue{IRValueType::label, new std::string(if_block1->label.name)}, IRValue{IRValueType::label, new std::string(else_block1->label.name)}});
+    auto ret = if_block1->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("func")}, IRValue{0}, IRValue{Type::ir_i32}});
+    if_block1->gen_inst(Instruction::ret, {ret});
+    else_block1->gen_inst(Instruction::ret, {IRValue{100}});
+
+    auto* func = main_module->gen_function_def("func", {Type::ir_i32}, Type::ir_i32);
+    auto* fn_body2 = func->get_block();
+    auto* bblock2 = fn_body2->get_bblock();
+    auto* if_block2 = fn_body2->new_basic_block();
+    auto* else_block2 = fn_body2->new_basic_block();
+    bblock2->gen_inst(Instruction::brnz, {func->get_param(0), IRValue{IRValueType::label, new std::string(if_block2->label.name)}, IRValue{IRValueType::label, new std::string(else_block2->label.name)}});
+    if_block2->gen_inst(Instruction::ret, {IRValue{3}});
+    else_block2->gen_inst(Instruction::ret, {IRValue{4}});
+
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    return execute(vm) == 4;
+}
+
 inline static bool function_call_1() {
     ARCVM_PROFILE();
     IRGenerator gen;
@@ -1485,79 +1543,1387 @@ inline static bool phi_1() {
     return execute(vm) == 20;
 }
 
-using namespace std::literals;
+// sum of 1..100 with the loop state carried in phis
+inline static bool phi_2() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body = main->get_block();
+    auto* bblock = fn_body->get_bblock();
+    auto* loop_block = fn_body->new_basic_block("loop");
+    auto* done_block = fn_body->new_basic_block("done");
+    bblock->gen_inst(Instruction::br, {IRValue{new std::string("loop")}});
+
+    // the incoming values from #loop are defined below, their names are known up front
+    auto i = loop_block->gen_inst(Instruction::phi, {IRValue{new std::string("main")}, IRValue{0}, IRValue{new std::string("loop")}, IRValue{IRValueType::reference, 2}});
+    auto sum = loop_block->gen_inst(Instruction::phi, {IRValue{new std::string("main")}, IRValue{0}, IRValue{new std::string("loop")}, IRValue{IRValueType::reference, 3}});
+    auto next_i = loop_block->gen_inst(Instruction::add, {i, IRValue{1}});
+    auto next_sum = loop_block->gen_inst(Instruction::add, {sum, next_i});
+    auto cond = loop_block->gen_inst(Instruction::lt, {next_i, IRValue{100}});
+    loop_block->gen_inst(Instruction::brnz, {cond, IRValue{new std::string("loop")}, IRValue{new std::string("done")}});
+    done_block->gen_inst(Instruction::ret, {next_sum});
 
-int main(int argc, char *argv[]) {
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    // run_passes(vm);
+    return next_i.value == 2 && next_sum.value == 3 && execute(vm) == 5050;
+}
+
+// phis that read each other have to be copied in parallel
+inline static bool phi_3() {
     ARCVM_PROFILE();
-    if(argc > 1 && "-noisy"sv == argv[1])
-        noisy = true;
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body = main->get_block();
+    auto* bblock = fn_body->get_bblock();
+    auto* loop_block = fn_body->new_basic_block("loop");
+    auto* done_block = fn_body->new_basic_block("done");
+    bblock->gen_inst(Instruction::br, {IRValue{new std::string("loop")}});
+
+    auto a = loop_block->gen_inst(Instruction::phi, {IRValue{new std::string("main")}, IRValue{1}, IRValue{new std::string("loop")}, IRValue{IRValueType::reference, 1}});
+    auto b = loop_block->gen_inst(Instruction::phi, {IRValue{new std::string("main")}, IRValue{2}, IRValue{new std::string("loop")}, a});
+    auto n = loop_block->gen_inst(Instruction::phi, {IRValue{new std::string("main")}, IRValue{0}, IRValue{new std::string("loop")}, IRValue{IRValueType::reference, 3}});
+    auto next_n = loop_block->gen_inst(Instruction::add, {n, IRValue{1}});
+    auto cond = loop_block->gen_inst(Instruction::lt, {next_n, IRValue{3}});
+    loop_block->gen_inst(Instruction::brnz, {cond, IRValue{new std::string("loop")}, IRValue{new std::string("done")}});
+    auto tens = done_block->gen_inst(Instruction::mul, {a, IRValue{10}});
+    auto result = done_block->gen_inst(Instruction::add, {tens, b});
+    done_block->gen_inst(Instruction::ret, {result});
 
-#ifdef POOL
-    ThreadPool test_thread_pool;
-#endif
+    print_module_if_noisy(main_module);
 
-    // run_test(test);
+    Arcvm vm;
+    vm.load_module(main_module);
+    // run_passes(vm);
+    return b.value == 1 && next_n.value == 3 && execute(vm) == 12;
+}
 
-// TODO create tests for combinations of immediates and references in instruction operands
-// most of these special cases aren't handled properly at the moment
+// a million back edges, this used to recurse once per branch
+inline static bool loop_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body = main->get_block();
+    auto* bblock = fn_body->get_bblock();
+    auto counter_ptr = bblock->gen_inst(Instruction::alloc, {IRValue{Type::ir_i64}});
+    bblock->gen_inst(Instruction::store, {counter_ptr, IRValue{0}, IRValue{Type::ir_i64}});
+    auto* loop_block = fn_body->new_basic_block("loop");
+    auto* done_block = fn_body->new_basic_block("done");
+    bblock->gen_inst(Instruction::br, {IRValue{IRValueType::label, new std::string("loop")}});
 
-    run_test(g_1);    // p
-    run_test(g_2);
-    run_test(g_3);
-    run_test(add_1);    // p
-    run_test(add_2);
-    run_test(add_3);
-    run_test(add_4);
-    run_test(sub_1);    // p
-    run_test(sub_2);
-    run_test(sub_3);
-    run_test(sub_4);
-    run_test(mul_1);    // p
-    run_test(mul_2);
-    run_test(mul_3);
-    run_test(mul_4);
-    run_test(div_1);
-    run_test(div_2);
-    run_test(div_3);
-    run_test(div_4);
-    run_test(mod_1);
-    run_test(mod_2);
-    run_test(mod_3);
-    run_test(mod_4);
-    run_test(bin_or_1);     // p
-    run_test(bin_or_2);
-    run_test(bin_or_3);
-    run_test(bin_or_4);
-    run_test(bin_and_1);    // p
-    run_test(bin_and_2);
-    run_test(bin_and_3);
-    run_test(bin_and_4);
-    run_test(bin_xor_1);    // p
-    run_test(lshift_1);
-    run_test(rshift_1);
-    run_test(lt_1);
-    run_test(gt_1);
-    run_test(lte_1);
-    run_test(lte_2);
-    run_test(lte_3);
-    run_test(gte_1);
-    run_test(gte_2);
-    run_test(gte_3);
-    run_test(index_1);
-    run_test(index_2);
-    run_test(arcvm_api_1);
-    run_test(brz_1);
-    run_test(brnz_1);
-    run_test(branch_1);
-    run_test(branch_2);
-    run_test(function_call_1);
-    run_test(function_call_2);
-    run_test(function_call_3);
-    run_test(CF_cleanup_1);
-    run_test(negate_1);
-    run_test(dup_1);
-    run_test(expr_1);
-    run_test(phi_1);
+    auto counter = loop_block->gen_inst(Instruction::load, {counter_ptr, IRValue{Type::ir_i64}});
+    auto next = loop_block->gen_inst(Instruction::add, {counter, IRValue{1}});
+    loop_block->gen_inst(Instruction::store, {counter_ptr, next, IRValue{Type::ir_i64}});
+    auto cond = loop_block->gen_inst(Instruction::lt, {next, IRValue{1000000}});
+    loop_block->gen_inst(Instruction::brnz, {cond, IRValue{IRValueType::label, new std::string("loop")}, IRValue{IRValueType::label, new std::string("done")}});
+
+    auto result = done_block->gen_inst(Instruction::load, {counter_ptr, IRValue{Type::ir_i64}});
+    done_block->gen_inst(Instruction::ret, {result});
+
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    return execute(vm) == 1000000;
+}
+
+// needs more registers than the old fixed size frames had
+inline static bool registers_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body = main->get_block();
+    auto* bblock = fn_body->get_bblock();
+    auto sum = bblock->gen_inst(Instruction::dup, {IRValue{0}});
+    for(i32 i = 1; i <= 300; ++i) {
+        auto val = bblock->gen_inst(Instruction::dup, {IRValue{i}});
+        sum = bblock->gen_inst(Instruction::add, {sum, val});
+    }
+    bblock->gen_inst(Instruction::ret, {sum});
+
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    // run_passes(vm);
+    return execute(vm) == 45150;
+}
+
+// sum(n) = n + sum(n - 1), deep enough to grow the register stack while frames are live
+inline static bool function_call_4() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body1 = main->get_block();
+    auto* bblock1 = fn_body1->get_bblock();
+    auto ret = bblock1->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("sum")}, IRValue{10000}, IRValue{Type::ir_i32}});
+    bblock1->gen_inst(Instruction::ret, {ret});
+
+    auto* func = main_module->gen_function_def("sum", {Type::ir_i32}, Type::ir_i32);
+    auto* fn_body2 = func->get_block();
+    auto* bblock2 = fn_body2->get_bblock();
+    auto* base_block = fn_body2->new_basic_block("base");
+    auto* rec_block = fn_body2->new_basic_block("rec");
+    auto cond = bblock2->gen_inst(Instruction::eq, {func->get_param(0), IRValue{0}});
+    bblock2->gen_inst(Instruction::brnz, {cond, IRValue{IRValueType::label, new std::string("base")}, IRValue{IRValueType::label, new std::string("rec")}});
+    base_block->gen_inst(Instruction::ret, {IRValue{0}});
+    auto n = rec_block->gen_inst(Instruction::sub, {func->get_param(0), IRValue{1}});
+    auto partial = rec_block->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("sum")}, n, IRValue{Type::ir_i32}});
+    auto total = rec_block->gen_inst(Instruction::add, {func->get_param(0), partial});
+    rec_block->gen_inst(Instruction::ret, {total});
+
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    return execute(vm) == 50005000;
+}
+
+inline static bool alloc_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body1 = main->get_block();
+    auto* bblock1 = fn_body1->get_bblock();
+    auto ret = bblock1->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("sum")}, IRValue{10000}, IRValue{Type::ir_i32}});
+    bblock1->gen_inst(Instruction::ret, {ret});
+
+    // every frame keeps its argument in memory across the recursive call
+    auto* func = main_module->gen_function_def("sum", {Type::ir_i32}, Type::ir_i32);
+    auto* fn_body2 = func->get_block();
+    auto* bblock2 = fn_body2->get_bblock();
+    auto* base_block = fn_body2->new_basic_block("base");
+    auto* rec_block = fn_body2->new_basic_block("rec");
+    auto ptr = bblock2->gen_inst(Instruction::alloc, {IRValue{Type::ir_i32}});
+    bblock2->gen_inst(Instruction::store, {ptr, func->get_param(0), IRValue{Type::ir_i32}});
+    auto cond = bblock2->gen_inst(Instruction::eq, {func->get_param(0), IRValue{0}});
+    bblock2->gen_inst(Instruction::brnz, {cond, IRValue{IRValueType::label, new std::string("base")}, IRValue{IRValueType::label, new std::string("rec")}});
+    base_block->gen_inst(Instruction::ret, {IRValue{0}});
+    auto n = rec_block->gen_inst(Instruction::sub, {func->get_param(0), IRValue{1}});
+    auto partial = rec_block->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("sum")}, n, IRValue{Type::ir_i32}});
+    auto saved = rec_block->gen_inst(Instruction::load, {ptr, IRValue{Type::ir_i32}});
+    auto total = rec_block->gen_inst(Instruction::add, {saved, partial});
+    rec_block->gen_inst(Instruction::ret, {total});
+
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    return execute(vm) == 50005000;
+}
+
+// every pattern in the superinstruction table shows up here
+inline static bool fusion_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body = main->get_block();
+    auto* bblock = fn_body->get_bblock();
+    auto counter_ptr = bblock->gen_inst(Instruction::alloc, {IRValue{Type::ir_i32}});
+    bblock->gen_inst(Instruction::store, {counter_ptr, IRValue{0}, IRValue{Type::ir_i32}});
+    auto sum_ptr = bblock->gen_inst(Instruction::alloc, {IRValue{Type::ir_i64}});
+    bblock->gen_inst(Instruction::store, {sum_ptr, IRValue{0}, IRValue{Type::ir_i64}});
+    auto* loop_block = fn_body->new_basic_block("loop");
+    auto* body_block = fn_body->new_basic_block("body");
+    auto* done_block = fn_body->new_basic_block("done");
+    bblock->gen_inst(Instruction::br, {IRValue{IRValueType::label, new std::string("loop")}});
+
+    auto counter = loop_block->gen_inst(Instruction::load, {counter_ptr, IRValue{Type::ir_i32}});
+    auto cond = loop_block->gen_inst(Instruction::gte, {counter, IRValue{100}});
+    loop_block->gen_inst(Instruction::brz, {cond, IRValue{IRValueType::label, new std::string("body")}, IRValue{IRValueType::label, new std::string("done")}});
+
+    auto value = body_block->gen_inst(Instruction::load, {counter_ptr, IRValue{Type::ir_i32}});
+    auto sum = body_block->gen_inst(Instruction::load, {sum_ptr, IRValue{Type::ir_i64}});
+    auto new_sum = body_block->gen_inst(Instruction::add, {sum, value});
+    body_block->gen_inst(Instruction::store, {sum_ptr, new_sum, IRValue{Type::ir_i64}});
+    auto old_counter = body_block->gen_inst(Instruction::load, {counter_ptr, IRValue{Type::ir_i32}});
+    auto new_counter = body_block->gen_inst(Instruction::add, {old_counter, IRValue{1}, IRValue{Type::ir_i32}});
+    body_block->gen_inst(Instruction::store, {counter_ptr, new_counter, IRValue{Type::ir_i32}});
+    body_block->gen_inst(Instruction::br, {IRValue{IRValueType::label, new std::string("loop")}});
+
+    auto total = done_block->gen_inst(Instruction::load, {sum_ptr, IRValue{Type::ir_i64}});
+    auto new_total = done_block->gen_inst(Instruction::sub, {total, IRValue{950}});
+    done_block->gen_inst(Instruction::store, {sum_ptr, new_total, IRValue{Type::ir_i64}});
+    auto result = done_block->gen_inst(Instruction::load, {sum_ptr, IRValue{Type::ir_i64}});
+    done_block->gen_inst(Instruction::ret, {result});
+
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    return execute(vm) == 4000;
+}
+
+// load_<op>_store only fuses when the op's type is as wide as memory, the i8 add is left
+// unfused and sign extends its result into the i32 it's stored in
+inline static bool load_op_store_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* bblock = main->get_block()->get_bblock();
+    auto narrow_ptr = bblock->gen_inst(Instruction::alloc, {IRValue{Type::ir_i32}});
+    bblock->gen_inst(Instruction::store, {narrow_ptr, IRValue{100}, IRValue{Type::ir_i32}});
+    auto wide_ptr = bblock->gen_inst(Instruction::alloc, {IRValue{Type::ir_i16}});
+    bblock->gen_inst(Instruction::store, {wide_ptr, IRValue{300}, IRValue{Type::ir_i16}});
+
+    auto narrow = bblock->gen_inst(Instruction::load, {narrow_ptr, IRValue{Type::ir_i32}});
+    auto narrow_sum = bblock->gen_inst(Instruction::add, {narrow, IRValue{100}, IRValue{Type::ir_i8}});
+    bblock->gen_inst(Instruction::store, {narrow_ptr, narrow_sum, IRValue{Type::ir_i32}});
+    auto wide = bblock->gen_inst(Instruction::load, {wide_ptr, IRValue{Type::ir_i16}});
+    auto wide_product = bblock->gen_inst(Instruction::mul, {wide, IRValue{300}, IRValue{Type::ir_i32}});
+    bblock->gen_inst(Instruction::store, {wide_ptr, wide_product, IRValue{Type::ir_i16}});
+
+    auto first = bblock->gen_inst(Instruction::load, {narrow_ptr, IRValue{Type::ir_i32}});
+    auto second = bblock->gen_inst(Instruction::load, {wide_ptr, IRValue{Type::ir_i16}});
+    auto result = bblock->gen_inst(Instruction::add, {first, second});
+    bblock->gen_inst(Instruction::ret, {result});
+
+    print_module_if_noisy(main_module);
+
+    IRDecoder decoder;
+    auto bytecode = decoder.decode(main_module);
+    auto fused = 0;
+    for(auto const& op : bytecode.functions[0].code)
+        fused += op.opcode == OpCode::load_mul_store_i16;
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    // 200 wraps to -56 as an i8, 90000 wraps to 24464 as an i16
+    return fused == 1 && execute(vm) == 24408;
+}
+
+// calls go both ways between the two modules
+inline static bool modules_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body1 = main->get_block();
+    auto* bblock1 = fn_body1->get_bblock();
+    auto ret = bblock1->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("twice")}, IRValue{21}, IRValue{Type::ir_i32}});
+    bblock1->gen_inst(Instruction::ret, {ret});
+
+    auto* identity = main_module->gen_function_def("identity", {Type::ir_i32}, Type::ir_i32);
+    auto* fn_body2 = identity->get_block();
+    auto* bblock2 = fn_body2->get_bblock();
+    bblock2->gen_inst(Instruction::ret, {identity->get_param(0)});
+
+    auto* other_module = gen.create_module();
+    auto* twice = other_module->gen_function_def("twice", {Type::ir_i32}, Type::ir_i32);
+    auto* fn_body3 = twice->get_block();
+    auto* bblock3 = fn_body3->get_bblock();
+    auto same = bblock3->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("identity")}, twice->get_param(0), IRValue{Type::ir_i32}});
+    auto sum = bblock3->gen_inst(Instruction::add, {same, twice->get_param(0)});
+    bblock3->gen_inst(Instruction::ret, {sum});
+
+    print_module_if_noisy(main_module);
+    print_module_if_noisy(other_module);
+
+    Arcvm vm;
+    vm.load_module(other_module);
+    vm.load_module(main_module);
+    run_passes(vm);
+    return execute(vm) == 42;
+}
+
+// one frozen module shared by interpreters on several threads
+inline static bool threads_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body1 = main->get_block();
+    auto* bblock1 = fn_body1->get_bblock();
+    auto ret = bblock1->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("sum")}, IRValue{1000}, IRValue{Type::ir_i32}});
+    bblock1->gen_inst(Instruction::ret, {ret});
+
+    auto* func = main_module->gen_function_def("sum", {Type::ir_i32}, Type::ir_i32);
+    auto* fn_body2 = func->get_block();
+    auto* bblock2 = fn_body2->get_bblock();
+    auto* base_block = fn_body2->new_basic_block("base");
+    auto* rec_block = fn_body2->new_basic_block("rec");
+    auto ptr = bblock2->gen_inst(Instruction::alloc, {IRValue{Type::ir_i32}});
+    bblock2->gen_inst(Instruction::store, {ptr, func->get_param(0), IRValue{Type::ir_i32}});
+    auto cond = bblock2->gen_inst(Instruction::eq, {func->get_param(0), IRValue{0}});
+    bblock2->gen_inst(Instruction::brnz, {cond, IRValue{IRValueType::label, new std::string("base")}, IRValue{IRValueType::label, new std::string("rec")}});
+    base_block->gen_inst(Instruction::ret, {IRValue{0}});
+    auto n = rec_block->gen_inst(Instruction::sub, {func->get_param(0), IRValue{1}});
+    auto partial = rec_block->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("sum")}, n, IRValue{Type::ir_i32}});
+    auto saved = rec_block->gen_inst(Instruction::load, {ptr, IRValue{Type::ir_i32}});
+    auto total = rec_block->gen_inst(Instruction::add, {saved, partial});
+    rec_block->gen_inst(Instruction::ret, {total});
+
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    auto frozen = vm.freeze();
+
+    std::atomic<i32> correct = 0;
+    std::vector<std::thread> threads;
+    for(i32 i = 0; i < 8; ++i) {
+        threads.emplace_back([&] {
+            for(i32 j = 0; j < 50; ++j) {
+                IRInterpreter interp(frozen);
+                if(interp.run() == 500500)
+                    ++correct;
+            }
+        });
+    }
+    for(auto& thread : threads)
+        thread.join();
+    return correct == 8 * 50;
+}
+
+inline static bool profile_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body = main->get_block();
+    auto* bblock = fn_body->get_bblock();
+    auto counter_ptr = bblock->gen_inst(Instruction::alloc, {IRValue{Type::ir_i32}});
+    bblock->gen_inst(Instruction::store, {counter_ptr, IRValue{0}, IRValue{Type::ir_i32}});
+    auto* loop_block = fn_body->new_basic_block("loop");
+    auto* body_block = fn_body->new_basic_block("body");
+    auto* done_block = fn_body->new_basic_block("done");
+    bblock->gen_inst(Instruction::br, {IRValue{IRValueType::label, new std::string("loop")}});
+
+    auto counter = loop_block->gen_inst(Instruction::load, {counter_ptr, IRValue{Type::ir_i32}});
+    auto cond = loop_block->gen_inst(Instruction::lt, {counter, IRValue{10}});
+    loop_block->gen_inst(Instruction::brnz, {cond, IRValue{IRValueType::label, new std::string("body")}, IRValue{IRValueType::label, new std::string("done")}});
+
+    auto next = body_block->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("inc")}, counter, IRValue{Type::ir_i32}});
+    body_block->gen_inst(Instruction::store, {counter_ptr, next, IRValue{Type::ir_i32}});
+    body_block->gen_inst(Instruction::br, {IRValue{IRValueType::label, new std::string("loop")}});
+
+    auto result = done_block->gen_inst(Instruction::load, {counter_ptr, IRValue{Type::ir_i32}});
+    done_block->gen_inst(Instruction::ret, {result});
+
+    auto* inc = main_module->gen_function_def("inc", {Type::ir_i32}, Type::ir_i32);
+    auto* inc_block = inc->get_block()->get_bblock();
+    auto sum = inc_block->gen_inst(Instruction::add, {inc->get_param(0), IRValue{1}, IRValue{Type::ir_i32}});
+    inc_block->gen_inst(Instruction::ret, {sum});
+
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    IRInterpreter interp(vm.freeze(true));
+    if(interp.run() != 10)
+        return false;
+
+    std::ostringstream json;
+    interp.dump_profile(json);
+    if(noisy)
+        std::cout << json.str();
+    auto profile = json.str();
+    return profile.find("\"loop\": {\"count\": 11, \"taken\": 10, \"not_taken\": 1}") != std::string::npos &&
+        profile.find("\"body\": {\"count\": 10, \"calls\": [{\"callee\": \"inc\", \"count\": 10}]}") != std::string::npos &&
+        profile.find("\"done\": {\"count\": 1}") != std::string::npos &&
+        profile.find("\"inc\": {\"count\": 10}") != std::string::npos;
+}
+
+// the decoded module keeps its own names, the IR it came from is gone before it runs
+inline static bool profile_2() {
+    ARCVM_PROFILE();
+    FrozenModule bytecode;
+    {
+        IRGenerator gen;
+        auto* main_module = gen.create_module();
+        auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+        main->add_attribute(Attribute::entrypoint);
+        auto* fn_body = main->get_block();
+        auto* bblock = fn_body->get_bblock();
+        auto* exit_block = fn_body->new_basic_block("exit");
+        bblock->gen_inst(Instruction::br, {exit_block->label_value()});
+        exit_block->gen_inst(Instruction::ret, {IRValue{4}});
+        bblock->remove_entry(0);
+        bblock->insert_entry(0, IRValue{}, Instruction::br, {exit_block->label_value()});
+
+        Arcvm vm;
+        vm.load_module(main_module);
+        bytecode = vm.freeze(true);
+        if(!main_module->is_compact())
+            return false;
+    }
+    IRInterpreter interp(bytecode);
+    if(interp.run() != 4)
+        return false;
+    std::ostringstream json;
+    interp.dump_profile(json);
+    return json.str().find("\"main\": {") != std::string::npos &&
+        json.str().find("\"exit\": {\"count\": 1}") != std::string::npos;
+}
+
+// the compiler here fakes native code that returns 2 instead of 1 to see when calls switch over
+inline static bool tiered_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body = main->get_block();
+    auto* bblock = fn_body->get_bblock();
+    auto counter_ptr = bblock->gen_inst(Instruction::alloc, {IRValue{Type::ir_i32}});
+    bblock->gen_inst(Instruction::store, {counter_ptr, IRValue{0}, IRValue{Type::ir_i32}});
+    auto sum_ptr = bblock->gen_inst(Instruction::alloc, {IRValue{Type::ir_i32}});
+    bblock->gen_inst(Instruction::store, {sum_ptr, IRValue{0}, IRValue{Type::ir_i32}});
+    auto* loop_block = fn_body->new_basic_block("loop");
+    auto* done_block = fn_body->new_basic_block("done");
+    bblock->gen_inst(Instruction::br, {IRValue{IRValueType::label, new std::string("loop")}});
+
+    auto value = loop_block->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("value")}, IRValue{Type::ir_i32}});
+    auto sum = loop_block->gen_inst(Instruction::load, {sum_ptr, IRValue{Type::ir_i32}});
+    auto new_sum = loop_block->gen_inst(Instruction::add, {sum, value, IRValue{Type::ir_i32}});
+    loop_block->gen_inst(Instruction::store, {sum_ptr, new_sum, IRValue{Type::ir_i32}});
+    auto counter = loop_block->gen_inst(Instruction::load, {counter_ptr, IRValue{Type::ir_i32}});
+    auto next = loop_block->gen_inst(Instruction::add, {counter, IRValue{1}, IRValue{Type::ir_i32}});
+    loop_block->gen_inst(Instruction::store, {counter_ptr, next, IRValue{Type::ir_i32}});
+    auto cond = loop_block->gen_inst(Instruction::lt, {next, IRValue{2000}});
+    loop_block->gen_inst(Instruction::brnz, {cond, IRValue{IRValueType::label, new std::string("loop")}, IRValue{IRValueType::label, new std::string("done")}});
+
+    auto result = done_block->gen_inst(Instruction::load, {sum_ptr, IRValue{Type::ir_i32}});
+    done_block->gen_inst(Instruction::ret, {result});
+
+    auto* func = main_module->gen_function_def("value", {}, Type::ir_i32);
+    func->get_block()->get_bblock()->gen_inst(Instruction::ret, {IRValue{1}});
+
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+
+    i32 compiled = 0;
+    IRInterpreter interp(vm.freeze());
+    interp.enable_tiering(TierPolicy{1000, 10000}, [&](BytecodeFunction const& function) -> NativeFunction {
+        ++compiled;
+        if(function.name != "value")
+            return nullptr;
+        return [](i64 const*) -> i64 { return 2; };
+    });
+    // main is never called so only value gets compiled, and only once
+    return interp.run() == 999 + 1001 * 2 && compiled == 1;
+}
+
+// a million calls deep, every one of them in tail position
+inline static bool tail_call_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* bblock1 = main->get_block()->get_bblock();
+    auto ret = bblock1->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("count")}, IRValue{1000000}, IRValue{0}, IRValue{Type::ir_i32}});
+    bblock1->gen_inst(Instruction::ret, {ret});
+
+    auto* func = main_module->gen_function_def("count", {Type::ir_i32, Type::ir_i32}, Type::ir_i32);
+    auto* fn_body = func->get_block();
+    auto* bblock2 = fn_body->get_bblock();
+    auto* base_block = fn_body->new_basic_block("base");
+    auto* rec_block = fn_body->new_basic_block("rec");
+    auto cond = bblock2->gen_inst(Instruction::eq, {func->get_param(0), IRValue{0}});
+    bblock2->gen_inst(Instruction::brnz, {cond, IRValue{IRValueType::label, new std::string("base")}, IRValue{IRValueType::label, new std::string("rec")}});
+    base_block->gen_inst(Instruction::ret, {func->get_param(1)});
+    auto n = rec_block->gen_inst(Instruction::sub, {func->get_param(0), IRValue{1}});
+    auto acc = rec_block->gen_inst(Instruction::add, {func->get_param(1), IRValue{1}});
+    auto result = rec_block->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("count")}, n, acc, IRValue{Type::ir_i32}});
+    rec_block->gen_inst(Instruction::ret, {result});
+
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    return execute(vm) == 1000000;
+}
+
+// every step allocs a slot that nothing outside the frame sees, so the tail call can drop it
+// and the whole recursion fits in the first chunk of the stack memory
+inline static bool tail_call_alloc_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* bblock1 = main->get_block()->get_bblock();
+    auto ret = bblock1->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("count")}, IRValue{1000000}, IRValue{0}, IRValue{Type::ir_i32}});
+    bblock1->gen_inst(Instruction::ret, {ret});
+
+    auto* func = main_module->gen_function_def("count", {Type::ir_i32, Type::ir_i32}, Type::ir_i32);
+    auto* fn_body = func->get_block();
+    auto* bblock2 = fn_body->get_bblock();
+    auto* base_block = fn_body->new_basic_block("base");
+    auto* rec_block = fn_body->new_basic_block("rec");
+    auto cond = bblock2->gen_inst(Instruction::eq, {func->get_param(0), IRValue{0}});
+    bblock2->gen_inst(Instruction::brnz, {cond, IRValue{IRValueType::label, new std::string("base")}, IRValue{IRValueType::label, new std::string("rec")}});
+    base_block->gen_inst(Instruction::ret, {func->get_param(1)});
+    auto slot = rec_block->gen_inst(Instruction::alloc, {IRValue{Type::ir_i32}});
+    rec_block->gen_inst(Instruction::store, {slot, func->get_param(1), IRValue{Type::ir_i32}});
+    auto acc = rec_block->gen_inst(Instruction::load, {slot, IRValue{Type::ir_i32}});
+    auto n = rec_block->gen_inst(Instruction::sub, {func->get_param(0), IRValue{1}});
+    auto next = rec_block->gen_inst(Instruction::add, {acc, IRValue{1}});
+    auto result = rec_block->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("count")}, n, next, IRValue{Type::ir_i32}});
+    rec_block->gen_inst(Instruction::ret, {result});
+
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    IRInterpreter interp(vm.freeze());
+    return interp.run() == 1000000 && interp.stack_memory_reserved() <= 64 * 1024;
+}
+
+// every step allocs a slot, passes it to a call and hands it to the next step through the tail call
+// the slot the arguments point into is moved down over the rest, so memory stays flat
+inline static bool tail_call_alloc_2() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* bblock1 = main->get_block()->get_bblock();
+    auto start = bblock1->gen_inst(Instruction::alloc, {IRValue{Type::ir_i64}});
+    bblock1->gen_inst(Instruction::store, {start, IRValue{0}, IRValue{Type::ir_i64}});
+    auto ret = bblock1->gen_inst(Instruction::call, {main_module->function_name("count"), IRValue{1000000}, start, IRValue{Type::ir_i32}});
+    bblock1->gen_inst(Instruction::ret, {ret});
+
+    auto* read = main_module->gen_function_def("read", {Type::ir_i64}, Type::ir_i64);
+    auto* bblock2 = read->get_block()->get_bblock();
+    auto value = bblock2->gen_inst(Instruction::load, {read->get_param(0), IRValue{Type::ir_i64}});
+    bblock2->gen_inst(Instruction::ret, {value});
+
+    auto* func = main_module->gen_function_def("count", {Type::ir_i32, Type::ir_i64}, Type::ir_i32);
+    auto* fn_body = func->get_block();
+    auto* bblock3 = fn_body->get_bblock();
+    auto* base_block = fn_body->new_basic_block("base");
+    auto* rec_block = fn_body->new_basic_block("rec");
+    auto cond = bblock3->gen_inst(Instruction::eq, {func->get_param(0), IRValue{0}});
+    bblock3->gen_inst(Instruction::brnz, {cond, base_block->label_value(), rec_block->label_value()});
+    auto last = base_block->gen_inst(Instruction::call, {main_module->function_name("read"), func->get_param(1), IRValue{Type::ir_i64}});
+    base_block->gen_inst(Instruction::ret, {last});
+    auto slot = rec_block->gen_inst(Instruction::alloc, {IRValue{Type::ir_i64}});
+    auto previous = rec_block->gen_inst(Instruction::load, {func->get_param(1), IRValue{Type::ir_i64}});
+    auto next = rec_block->gen_inst(Instruction::add, {previous, IRValue{1}});
+    rec_block->gen_inst(Instruction::store, {slot, next, IRValue{Type::ir_i64}});
+    rec_block->gen_inst(Instruction::call, {main_module->function_name("read"), slot, IRValue{Type::ir_i64}});
+    auto n = rec_block->gen_inst(Instruction::sub, {func->get_param(0), IRValue{1}});
+    auto result = rec_block->gen_inst(Instruction::call, {main_module->function_name("count"), n, slot, IRValue{Type::ir_i32}});
+    rec_block->gen_inst(Instruction::ret, {result});
+
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    IRInterpreter interp(vm.freeze());
+    return interp.run() == 1000000 && interp.stack_memory_reserved() <= 64 * 1024;
+}
+
+// the arguments of the tail call swap the parameters around
+inline static bool tail_call_2() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* bblock1 = main->get_block()->get_bblock();
+    auto ret = bblock1->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("fib")}, IRValue{40}, IRValue{0}, IRValue{1}, IRValue{Type::ir_i32}});
+    bblock1->gen_inst(Instruction::ret, {ret});
+
+    auto* func = main_module->gen_function_def("fib", {Type::ir_i32, Type::ir_i32, Type::ir_i32}, Type::ir_i32);
+    auto* fn_body = func->get_block();
+    auto* bblock2 = fn_body->get_bblock();
+    auto* base_block = fn_body->new_basic_block("base");
+    auto* rec_block = fn_body->new_basic_block("rec");
+    auto cond = bblock2->gen_inst(Instruction::eq, {func->get_param(0), IRValue{0}});
+    bblock2->gen_inst(Instruction::brnz, {cond, IRValue{IRValueType::label, new std::string("base")}, IRValue{IRValueType::label, new std::string("rec")}});
+    base_block->gen_inst(Instruction::ret, {func->get_param(1)});
+    auto n = rec_block->gen_inst(Instruction::sub, {func->get_param(0), IRValue{1}});
+    auto next = rec_block->gen_inst(Instruction::add, {func->get_param(1), func->get_param(2)});
+    auto result = rec_block->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("fib")}, n, func->get_param(2), next, IRValue{Type::ir_i32}});
+    rec_block->gen_inst(Instruction::ret, {result});
+
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    return execute(vm) == 102334155;
+}
+
+// immediates are read from constant registers that every frame of a recursive call gets its own copy of
+inline static bool constants_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* bblock1 = main->get_block()->get_bblock();
+    auto ret = bblock1->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("f")}, IRValue{10}, IRValue{Type::ir_i32}});
+    bblock1->gen_inst(Instruction::ret, {ret});
+
+    auto* func = main_module->gen_function_def("f", {Type::ir_i32}, Type::ir_i32);
+    auto* fn_body = func->get_block();
+    auto* bblock2 = fn_body->get_bblock();
+    auto* base_block = fn_body->new_basic_block("base");
+    auto* rec_block = fn_body->new_basic_block("rec");
+    auto cond = bblock2->gen_inst(Instruction::eq, {func->get_param(0), IRValue{0}});
+    bblock2->gen_inst(Instruction::brnz, {cond, IRValue{IRValueType::label, new std::string("base")}, IRValue{IRValueType::label, new std::string("rec")}});
+    base_block->gen_inst(Instruction::ret, {IRValue{3}});
+    auto n = rec_block->gen_inst(Instruction::sub, {func->get_param(0), IRValue{1}});
+    auto result = rec_block->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("f")}, n, IRValue{Type::ir_i32}});
+    auto sum = rec_block->gen_inst(Instruction::add, {result, IRValue{3}});
+    rec_block->gen_inst(Instruction::ret, {sum});
+
+    print_module_if_noisy(main_module);
+
+    IRDecoder decoder;
+    auto bytecode = decoder.decode(main_module);
+    for(auto const& function : bytecode.functions) {
+        for(auto const& op : function.code) {
+            bool callee = op.opcode == OpCode::call || op.opcode == OpCode::tail_call;
+            if((op.a_kind == OperandKind::imm && !callee) || op.b_kind == OperandKind::imm)
+                return false;
+        }
+        for(auto const& operand : function.operand_pool)
+            if(operand.kind == OperandKind::imm)
+                return false;
+    }
+    // both uses of 3 share a register
+    if(bytecode.functions[1].constants.size() != 3)
+        return false;
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    return execute(vm) == 33;
+}
+
+// naive fib only finishes quickly once its results are cached, set writes through its parameter so it isn't pure
+inline static bool memo_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* bblock1 = main->get_block()->get_bblock();
+    auto ptr = bblock1->gen_inst(Instruction::alloc, {IRValue{Type::ir_i32}});
+    bblock1->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("set")}, ptr, IRValue{Type::ir_i32}});
+    auto value = bblock1->gen_inst(Instruction::load, {ptr, IRValue{Type::ir_i32}});
+    auto fib = bblock1->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("fib")}, IRValue{40}, IRValue{Type::ir_i32}});
+    auto sum = bblock1->gen_inst(Instruction::add, {fib, value});
+    bblock1->gen_inst(Instruction::ret, {sum});
+
+    auto* set_func = main_module->gen_function_def("set", {Type::ir_i32}, Type::ir_i32);
+    auto* bblock2 = set_func->get_block()->get_bblock();
+    bblock2->gen_inst(Instruction::store, {set_func->get_param(0), IRValue{5}, IRValue{Type::ir_i32}});
+    bblock2->gen_inst(Instruction::ret, {IRValue{0}});
+
+    auto* fib_func = main_module->gen_function_def("fib", {Type::ir_i32}, Type::ir_i32);
+    auto* fn_body = fib_func->get_block();
+    auto* bblock3 = fn_body->get_bblock();
+    auto* base_block = fn_body->new_basic_block("base");
+    auto* rec_block = fn_body->new_basic_block("rec");
+    auto cond = bblock3->gen_inst(Instruction::lt, {fib_func->get_param(0), IRValue{2}});
+    bblock3->gen_inst(Instruction::brnz, {cond, IRValue{IRValueType::label, new std::string("base")}, IRValue{IRValueType::label, new std::string("rec")}});
+    base_block->gen_inst(Instruction::ret, {fib_func->get_param(0)});
+    auto n1 = rec_block->gen_inst(Instruction::sub, {fib_func->get_param(0), IRValue{1}});
+    auto a = rec_block->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("fib")}, n1, IRValue{Type::ir_i32}});
+    auto n2 = rec_block->gen_inst(Instruction::sub, {fib_func->get_param(0), IRValue{2}});
+    auto b = rec_block->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("fib")}, n2, IRValue{Type::ir_i32}});
+    auto result = rec_block->gen_inst(Instruction::add, {a, b});
+    rec_block->gen_inst(Instruction::ret, {result});
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    print_module_if_noisy(main_module);
+
+    auto is_pure = [](Function* function) {
+        return std::find(function->attributes.begin(), function->attributes.end(), Attribute::pure) != function->attributes.end();
+    };
+    if(!is_pure(fib_func) || is_pure(set_func) || is_pure(main))
+        return false;
+
+    IRInterpreter interp(vm.freeze());
+    interp.enable_memoization(64);
+    return interp.run() == 102334155 + 5;
+}
+
+#ifdef ARCVM_TRACE
+// the trace only keeps the last four ops, the call into f is the one that falls out
+inline static bool trace_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* bblock1 = main->get_block()->get_bblock();
+    auto ret = bblock1->gen_inst(Instruction::call, {IRValue{IRValueType::fn_name, new std::string("f")}, IRValue{41}, IRValue{Type::ir_i32}});
+    auto doubled = bblock1->gen_inst(Instruction::mul, {ret, IRValue{2}});
+    bblock1->gen_inst(Instruction::ret, {doubled});
+
+    auto* func = main_module->gen_function_def("f", {Type::ir_i32}, Type::ir_i32);
+    auto* bblock2 = func->get_block()->get_bblock();
+    auto result = bblock2->gen_inst(Instruction::add, {func->get_param(0), IRValue{1}});
+    bblock2->gen_inst(Instruction::ret, {result});
+
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    IRInterpreter interp(vm.freeze());
+    interp.enable_tracing(4);
+    if(interp.run() != 84)
+        return false;
+    std::stringstream trace;
+    interp.dump_trace(trace);
+    return trace.str() ==
+        "f f 0 add_i64 42\n"
+        "f f 1 ret 42\n"
+        "main main 1 mul_i64 84\n"
+        "main main 2 ret 84\n";
+}
+#endif
+
+// the loop runs a different number of times in every lane, 100 inputs leave the second batch partly empty
+inline static bool batch_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* bblock1 = main->get_block()->get_bblock();
+    auto ret = bblock1->gen_inst(Instruction::call, {main_module->function_name("score"), IRValue{3}, IRValue{2}, IRValue{Type::ir_i32}});
+    bblock1->gen_inst(Instruction::ret, {ret});
+
+    // sum of i * k for i in 1..n
+    auto* func = main_module->gen_function_def("score", {Type::ir_i64, Type::ir_i64}, Type::ir_i64);
+    auto* fn_body = func->get_block();
+    auto* bblock2 = fn_body->get_bblock();
+    auto* loop_block = fn_body->new_basic_block("loop");
+    auto* done_block = fn_body->new_basic_block("done");
+    bblock2->gen_inst(Instruction::br, {loop_block->label_value()});
+    auto i = loop_block->gen_inst(Instruction::phi, {bblock2->label_value(), IRValue{0}, loop_block->label_value(), IRValue{IRValueType::reference, 4}});
+    auto sum = loop_block->gen_inst(Instruction::phi, {bblock2->label_value(), IRValue{0}, loop_block->label_value(), IRValue{IRValueType::reference, 6}});
+    auto next_i = loop_block->gen_inst(Instruction::add, {i, IRValue{1}});
+    auto term = loop_block->gen_inst(Instruction::mul, {next_i, func->get_param(1)});
+    auto next_sum = loop_block->gen_inst(Instruction::add, {sum, term});
+    auto cond = loop_block->gen_inst(Instruction::lt, {next_i, func->get_param(0)});
+    loop_block->gen_inst(Instruction::brnz, {cond, loop_block->label_value(), done_block->label_value()});
+    done_block->gen_inst(Instruction::ret, {next_sum});
+
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    auto bytecode = vm.freeze();
+    i32 score = -1;
+    for(size_t f = 0; f < bytecode->functions.size(); ++f)
+        if(bytecode->functions[f].name == "score")
+            score = (i32)f;
+    if(next_i.value != 4 || next_sum.value != 6 || !BatchInterpreter::can_batch(bytecode->functions[score]) ||
+        BatchInterpreter::can_batch(bytecode->functions[bytecode->entrypoint]))
+        return false;
+
+    std::vector<i64> args;
+    for(i64 n = 1; n <= 100; ++n) {
+        args.push_back(n);
+        args.push_back(n % 7 - 3);
+    }
+    std::vector<i64> results(100);
+    BatchInterpreter batch(bytecode);
+    batch.run_function(score, args, results);
+    for(i64 n = 1; n <= 100; ++n)
+        if(results[n - 1] != (n % 7 - 3) * n * (n + 1) / 2)
+            return false;
+
+    // main calls so every input goes through the regular interpreter
+    std::vector<i64> main_results(3);
+    batch.run_function(bytecode->entrypoint, {}, main_results);
+    return main_results == std::vector<i64>{12, 12, 12};
+}
+
+// every load and store is decoded with its width, the i8 load sign extends and the i16 store truncates
+inline static bool memory_widths_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* bblock = main->get_block()->get_bblock();
+    auto small = bblock->gen_inst(Instruction::alloc, {IRValue{Type::ir_i8}});
+    // keeps the alloc and store apart so they aren't fused into alloc_store
+    auto dummy = bblock->gen_inst(Instruction::add, {IRValue{1}, IRValue{1}});
+    bblock->gen_inst(Instruction::store, {small, IRValue{200}, IRValue{Type::ir_u8}});
+    auto byte = bblock->gen_inst(Instruction::load, {small, IRValue{Type::ir_i8}});
+    auto wide = bblock->gen_inst(Instruction::alloc, {IRValue{Type::ir_i16}});
+    bblock->gen_inst(Instruction::store, {wide, IRValue{70000}, IRValue{Type::ir_i16}});
+    auto half = bblock->gen_inst(Instruction::load, {wide, IRValue{Type::ir_i16}});
+    auto untyped = bblock->gen_inst(Instruction::alloc, {IRValue{Type::ir_i64}});
+    bblock->gen_inst(Instruction::store, {untyped, half});
+    auto word = bblock->gen_inst(Instruction::load, {untyped});
+    auto sum = bblock->gen_inst(Instruction::add, {byte, word});
+    auto result = bblock->gen_inst(Instruction::add, {sum, dummy});
+    bblock->gen_inst(Instruction::ret, {result});
+
+    print_module_if_noisy(main_module);
+
+    IRDecoder decoder;
+    auto bytecode = decoder.decode(main_module);
+    for(auto const& op : bytecode.functions[0].code)
+        if(op.opcode == OpCode::load || op.opcode == OpCode::store)
+            return false;
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    return execute(vm) == -56 + 70000 - 65536 + 2;
+}
+
+// entries of a block stay next to each other even when two blocks are filled in turns
+inline static bool ir_arena_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body = main->get_block();
+    auto* bblock = fn_body->get_bblock();
+    auto* other_block = fn_body->new_basic_block("other");
+    auto value = bblock->gen_inst(Instruction::dup, {IRValue{1}});
+    auto other_value = other_block->gen_inst(Instruction::dup, {IRValue{2}});
+    for(i32 i = 0; i < 20; ++i) {
+        value = bblock->gen_inst(Instruction::add, {value, IRValue{1}});
+        other_value = other_block->gen_inst(Instruction::add, {other_value, IRValue{1}});
+    }
+    bblock->gen_inst(Instruction::br, {other_block->label_value()});
+    auto result = other_block->gen_inst(Instruction::add, {value, other_value});
+    other_block->gen_inst(Instruction::ret, {result});
+
+    print_module_if_noisy(main_module);
+
+    // the first run of entries holds 8
+    for(i32 i = 1; i < 8; ++i)
+        if(bblock->entries()[i] != bblock->entries()[i - 1] + 1 || other_block->entries()[i] != other_block->entries()[i - 1] + 1)
+            return false;
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    return execute(vm) == 21 + 22;
+}
+
+// arguments stay inline up to three and keep their values when they spill, get copied or moved
+inline static bool small_vector_1() {
+    ARCVM_PROFILE();
+    Entry::Arguments args{IRValue{1}, IRValue{2}, IRValue{3}};
+    if(args.is_spilled())
+        return false;
+    args.push_back(IRValue{4});
+    args.push_back(IRValue{5});
+    if(!args.is_spilled() || args.size() != 5)
+        return false;
+    auto copy = args;
+    auto moved = std::move(args);
+    if(!args.empty() || args.is_spilled())
+        return false;
+    Entry::Arguments small{IRValue{7}};
+    auto moved_small = std::move(small);
+    for(i64 i = 0; i < 5; ++i)
+        if(copy[i].value != i + 1 || moved[i].value != i + 1)
+            return false;
+    return moved_small.size() == 1 && moved_small.back().value == 7 && !moved_small.is_spilled();
+}
+
+// labels and function names are interned once per module no matter which way the operand names them
+inline static bool symbols_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* add_one = main_module->gen_function_def("add_one", {Type::ir_i32}, Type::ir_i32);
+    auto* add_one_block = add_one->get_block()->get_bblock();
+    add_one_block->gen_inst(Instruction::ret, {add_one_block->gen_inst(Instruction::add, {add_one->get_param(0), IRValue{1}})});
+
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body = main->get_block();
+    auto* bblock = fn_body->get_bblock();
+    auto* other_block = fn_body->new_basic_block("other");
+    auto first = bblock->gen_inst(Instruction::call, {main_module->function_name("add_one"), IRValue{1}, IRValue{Type::ir_i32}});
+    bblock->gen_inst(Instruction::br, {other_block->label_value()});
+    auto second = other_block->gen_inst(Instruction::call, {main_module->function_name("add_one"), first, IRValue{Type::ir_i32}});
+    other_block->gen_inst(Instruction::ret, {second});
+
+    print_module_if_noisy(main_module);
+
+    auto& branch = bblock->entries().back()->arguments()[0];
+    auto& callee = other_block->entries()[0]->arguments()[0];
+    if(!branch.interned || branch.symbol != other_block->label.symbol || branch.symbol != main_module->label("other").symbol)
+        return false;
+    if(!callee.interned || callee.symbol != bblock->entries()[0]->arguments()[0].symbol)
+        return false;
+    // add_one, main and other
+    if(main_module->symbols.size() != 3 || main_module->symbols[callee.symbol->id] != callee.symbol)
+        return false;
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    return execute(vm) == 3;
+}
+
+// the per-field arrays of a block follow its entries through generation and every pass
+inline static bool entry_columns_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body = main->get_block();
+    auto* bblock = fn_body->get_bblock();
+    auto* next_block = fn_body->new_basic_block();
+    auto value = bblock->gen_inst(Instruction::dup, {IRValue{2}});
+    value = bblock->gen_inst(Instruction::mul, {value, IRValue{3}, IRValue{Type::ir_i32}});
+    auto ptr = bblock->gen_inst(Instruction::alloc, {IRValue{Type::ir_i32}});
+    bblock->gen_inst(Instruction::store, {ptr, value, IRValue{Type::ir_i32}});
+    // falls through into next_block, CFResolutionPass adds the br
+    auto loaded = next_block->gen_inst(Instruction::load, {ptr, IRValue{Type::ir_i32}});
+    next_block->gen_inst(Instruction::ret, {loaded});
+
+    print_module_if_noisy(main_module);
+
+    auto in_step = [&]() {
+        for(auto* b : fn_body->blocks) {
+            if(b->instructions.size() != b->entries().size() || b->dests.size() != b->entries().size() || b->types.size() != b->entries().size())
+                return false;
+            for(size_t i = 0; i < b->entries().size(); ++i) {
+                auto* entry = b->entries()[i];
+                if(b->instructions[i] != entry->instruction() || b->dests[i].type != entry->dest().type ||
+                       b->dests[i].value != entry->dest().value || b->types[i] != explicit_type(*entry))
+                    return false;
+            }
+        }
+        return true;
+    };
+    if(!in_step() || bblock->types[1] != Type::ir_i32 || bblock->types[0] != Type::none)
+        return false;
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    print_module_if_noisy(main_module);
+    if(!in_step() || bblock->instructions.back() != Instruction::br)
+        return false;
+    return execute(vm) == 6;
+}
+
+// every value knows its def and uses, which lets constants propagate past 100 values and across blocks
+inline static bool def_use_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body = main->get_block();
+    auto* bblock = fn_body->get_bblock();
+    auto* next_block = fn_body->new_basic_block();
+    auto value = bblock->gen_inst(Instruction::dup, {IRValue{0}});
+    auto first = value;
+    for(i32 i = 0; i < 150; ++i)
+        value = bblock->gen_inst(Instruction::add, {value, IRValue{1}});
+    auto doubled = bblock->gen_inst(Instruction::add, {first, first});
+    bblock->gen_inst(Instruction::br, {next_block->label_value()});
+    auto result = next_block->gen_inst(Instruction::add, {value, doubled});
+    next_block->gen_inst(Instruction::ret, {result});
+
+    auto& first_info = fn_body->value_info(first.value);
+    if(first_info.def != bblock->entries()[0])
+        return false;
+    // first is used twice by doubled and once by the first add
+    i32 use_count = 0;
+    for(auto* use = first_info.uses; use; use = use->next)
+        ++use_count;
+    if(use_count != 3 || fn_body->value_info(result.value).uses->user != next_block->entries().back())
+        return false;
+
+    print_module_if_noisy(main_module);
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    print_module_if_noisy(main_module);
+
+    // everything folds into the ret
+    if(bblock->entries().size() != 1 || next_block->entries().size() != 1 || fn_body->value_info(first.value).uses)
+        return false;
+    return execute(vm) == 150;
+}
+
+// removals and insertions keep every position valid until the block is compacted
+inline static bool entry_edits_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body = main->get_block();
+    auto* bblock = fn_body->get_bblock();
+    auto a = bblock->gen_inst(Instruction::dup, {IRValue{5}});
+    auto unused = bblock->gen_inst(Instruction::mul, {a, IRValue{100}});
+    auto b = bblock->gen_inst(Instruction::add, {a, IRValue{1}});
+    bblock->gen_inst(Instruction::ret, {b});
+
+    // b = a * 3 + 1 and unused goes away
+    bblock->remove_entry(1);
+    bblock->insert_entry(2, IRValue{IRValueType::reference, bblock->var_name}, Instruction::mul, {a, IRValue{3}});
+    auto tripled = IRValue{IRValueType::reference, bblock->var_name++};
+    fn_body->set_argument(bblock->entries()[2], 0, tripled);
+    if(bblock->entries().size() != 4 || bblock->instructions[2] != Instruction::add || bblock->is_compact())
+        return false;
+    if(fn_body->value_info(unused.value).def || !fn_body->value_info(tripled.value).def)
+        return false;
+
+    bblock->compact();
+    print_module_if_noisy(main_module);
+    if(bblock->entries().size() != 4 || bblock->instructions[1] != Instruction::mul || bblock->instructions[2] != Instruction::add)
+        return false;
+    if(bblock->entries()[1] != fn_body->value_info(tripled.value).def || fn_body->value_info(tripled.value).uses->user != bblock->entries()[2])
+        return false;
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    return execute(vm) == 16;
+}
+
+// replacing an entry with one of the same argument count keeps its Use array
+inline static bool entry_edits_2() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body = main->get_block();
+    auto* bblock = fn_body->get_bblock();
+    auto a = bblock->gen_inst(Instruction::dup, {IRValue{5}});
+    auto b = bblock->gen_inst(Instruction::dup, {IRValue{7}});
+    auto c = bblock->gen_inst(Instruction::add, {a, IRValue{1}});
+    bblock->gen_inst(Instruction::ret, {c});
+
+    auto* uses = bblock->entries()[2]->uses();
+    bblock->replace_entry(2, c, Instruction::mul, {b, a});
+    if(bblock->entries()[2]->uses() != uses)
+        return false;
+    if(fn_body->value_info(a.value).uses != &uses[1] || fn_body->value_info(b.value).uses != &uses[0] || uses[0].next || uses[1].next)
+        return false;
+    bblock->replace_entry(2, c, Instruction::dup, {b});
+    if(bblock->entries()[2]->uses() == uses || fn_body->value_info(a.value).uses)
+        return false;
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    return execute(vm) == 7;
+}
+
+// blocks made after one in the middle are placed once the function is compacted
+inline static bool block_insertion_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* fn_body = main->get_block();
+    auto* entry_block = fn_body->get_bblock();
+    auto* b = fn_body->new_basic_block("b");
+    auto* c = fn_body->new_basic_block("c");
+    fn_body->set_insertion_point(entry_block);
+    auto* d = fn_body->new_basic_block("d");
+    auto* e = fn_body->new_basic_block("e");
+    if(fn_body->blocks.size() != 3 || fn_body->get_bblock() != e)
+        return false;
+
+    entry_block->gen_inst(Instruction::br, {d->label_value()});
+    d->gen_inst(Instruction::br, {e->label_value()});
+    e->gen_inst(Instruction::br, {b->label_value()});
+    b->gen_inst(Instruction::br, {c->label_value()});
+    c->gen_inst(Instruction::ret, {IRValue{3}});
+
+    fn_body->compact();
+    print_module_if_noisy(main_module);
+    if(fn_body->blocks != std::vector<BasicBlock*>{entry_block, d, e, b, c})
+        return false;
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    run_passes(vm);
+    return execute(vm) == 3;
+}
+
+// run_function is a way in of its own, the profile and tier tables exist without a run() first
+inline static bool run_function_1() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    main->get_block()->get_bblock()->gen_inst(Instruction::ret, {IRValue{0}});
+
+    auto* func = main_module->gen_function_def("inc_twice", {Type::ir_i32}, Type::ir_i32);
+    auto* bblock = func->get_block()->get_bblock();
+    auto once = bblock->gen_inst(Instruction::call, {main_module->function_name("inc"), func->get_param(0), IRValue{Type::ir_i32}});
+    auto twice = bblock->gen_inst(Instruction::call, {main_module->function_name("inc"), once, IRValue{Type::ir_i32}});
+    bblock->gen_inst(Instruction::ret, {twice});
+
+    auto* inc = main_module->gen_function_def("inc", {Type::ir_i32}, Type::ir_i32);
+    auto* inc_block = inc->get_block()->get_bblock();
+    auto result = inc_block->gen_inst(Instruction::add, {inc->get_param(0), IRValue{1}});
+    inc_block->gen_inst(Instruction::ret, {result});
+
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    IRInterpreter interp(vm.freeze(true));
+    interp.enable_tiering(TierPolicy{1, 10000}, [](BytecodeFunction const&) -> NativeFunction { return nullptr; });
+    IRValue args[] = {IRValue{40}};
+    return interp.run_function(1, args).value == 42;
+}
+
+// one decoder can decode any number of times, calls always go to the function of the module being decoded
+inline static bool decode_twice_1() {
+    ARCVM_PROFILE();
+    auto build = [](IRGenerator& gen, bool callee_first) {
+        auto* module = gen.create_module();
+        auto gen_callee = [&]() {
+            auto* callee = module->gen_function_def("callee", {}, Type::ir_i32);
+            callee->get_block()->get_bblock()->gen_inst(Instruction::ret, {IRValue{1}});
+        };
+        if(callee_first)
+            gen_callee();
+        auto* main = module->gen_function_def("main", {}, Type::ir_i32);
+        main->add_attribute(Attribute::entrypoint);
+        auto* bblock = main->get_block()->get_bblock();
+        bblock->gen_inst(Instruction::ret, {bblock->gen_inst(Instruction::call, {module->function_name("callee"), IRValue{Type::ir_i32}})});
+        if(!callee_first)
+            gen_callee();
+        return module;
+    };
+    auto calls_callee = [](BytecodeModule const& bytecode) {
+        for(auto const& op : bytecode.functions[bytecode.entrypoint].code)
+            if(op.opcode == OpCode::call || op.opcode == OpCode::tail_call)
+                return ((BytecodeFunction const*)(uintptr_t)op.a)->name == "callee";
+        return false;
+    };
+
+    IRDecoder decoder;
+    {
+        IRGenerator gen;
+        if(!calls_callee(decoder.decode(build(gen, false))))
+            return false;
+    }
+    // the functions are in the other order now and the module can be where the last one was
+    IRGenerator gen;
+    auto* module = build(gen, true);
+    print_module_if_noisy(module);
+    return calls_callee(decoder.decode(module)) && calls_callee(decoder.decode(module));
+}
+
+// a loop makes its function hot for the next call, which gets the arguments natively
+// only the br closing the loop is a backedge, not the forward branches into the phi block
+inline static bool tiered_2() {
+    ARCVM_PROFILE();
+    IRGenerator gen;
+    auto* main_module = gen.create_module();
+    auto* main = main_module->gen_function_def("main", {}, Type::ir_i32);
+    main->add_attribute(Attribute::entrypoint);
+    auto* main_block = main->get_block()->get_bblock();
+    auto sum_to = [&](i32 n) {
+        return main_block->gen_inst(Instruction::call, {main_module->function_name("sum_to"), IRValue{n}, IRValue{Type::ir_i32}});
+    };
+    auto a = sum_to(10);
+    auto b = sum_to(10);
+    auto c = sum_to(10);
+    auto d = sum_to(20);
+    auto ab = main_block->gen_inst(Instruction::add, {a, b});
+    auto cd = main_block->gen_inst(Instruction::add, {c, d});
+    main_block->gen_inst(Instruction::ret, {main_block->gen_inst(Instruction::add, {ab, cd})});
+
+    auto* func = main_module->gen_function_def("sum_to", {Type::ir_i32}, Type::ir_i32);
+    auto* fn_body = func->get_block();
+    auto* entry_block = fn_body->get_bblock();
+    auto* loop_block = fn_body->new_basic_block("loop");
+    auto* body_block = fn_body->new_basic_block("body");
+    auto* done_block = fn_body->new_basic_block("done");
+    entry_block->gen_inst(Instruction::br, {loop_block->label_value()});
+    auto i = loop_block->gen_inst(Instruction::phi, {entry_block->label_value(), IRValue{0}, body_block->label_value(), IRValue{IRValueType::reference, 4}});
+    auto sum = loop_block->gen_inst(Instruction::phi, {entry_block->label_value(), IRValue{0}, body_block->label_value(), IRValue{IRValueType::reference, 5}});
+    auto cond = loop_block->gen_inst(Instruction::lt, {i, func->get_param(0)});
+    loop_block->gen_inst(Instruction::brnz, {cond, body_block->label_value(), done_block->label_value()});
+    auto next_i = body_block->gen_inst(Instruction::add, {i, IRValue{1}});
+    body_block->gen_inst(Instruction::add, {sum, next_i});
+    body_block->gen_inst(Instruction::br, {loop_block->label_value()});
+    done_block->gen_inst(Instruction::ret, {sum});
+
+    print_module_if_noisy(main_module);
+
+    Arcvm vm;
+    vm.load_module(main_module);
+    auto bytecode = vm.freeze();
+    i32 backedges = 0;
+    for(auto const& op : bytecode->functions[1].code)
+        backedges += op.opcode == OpCode::br_back;
+    if(backedges != 1)
+        return false;
+
+    i32 compiled = 0;
+    IRInterpreter interp(bytecode);
+    interp.enable_tiering(TierPolicy{1000, 15}, [&](BytecodeFunction const&) -> NativeFunction {
+        ++compiled;
+        // marks the native results so they can be told apart
+        return [](i64 const* args) -> i64 { return args[0] * (args[0] + 1) / 2 + 1000; };
+    });
+    // the second call crosses 15 backedges, the last two run natively
+    return interp.run() == 55 + 55 + 1055 + 1210 && compiled == 1;
+}
+
+using namespace std::literals;
+
+int main(int argc, char *argv[]) {
+    ARCVM_PROFILE();
+    if(argc > 1 && "-noisy"sv == argv[1])
+        noisy = true;
+
+#ifdef POOL
+    ThreadPool test_thread_pool;
+#endif
+
+    // run_test(test);
+
+// TODO create tests for combinations of immediates and references in instruction operands
+// most of these special cases aren't handled properly at the moment
+
+    run_test(g_1);    // p
+    run_test(g_2);
+    run_test(g_3);
+    run_test(add_1);    // p
+    run_test(add_2);
+    run_test(add_3);
+    run_test(add_4);
+    run_test(sub_1);    // p
+    run_test(sub_2);
+    run_test(sub_3);
+    run_test(sub_4);
+    run_test(mul_1);    // p
+    run_test(mul_2);
+    run_test(mul_3);
+    run_test(mul_4);
+    run_test(div_1);
+    run_test(div_2);
+    run_test(div_3);
+    run_test(div_4);
+    run_test(mod_1);
+    run_test(mod_2);
+    run_test(mod_3);
+    run_test(mod_4);
+    run_test(bin_or_1);     // p
+    run_test(bin_or_2);
+    run_test(bin_or_3);
+    run_test(bin_or_4);
+    run_test(bin_and_1);    // p
+    run_test(bin_and_2);
+    run_test(bin_and_3);
+    run_test(bin_and_4);
+    run_test(bin_xor_1);    // p
+    run_test(lshift_1);
+    run_test(rshift_1);
+    run_test(lt_1);
+    run_test(gt_1);
+    run_test(lte_1);
+    run_test(lte_2);
+    run_test(lte_3);
+    run_test(gte_1);
+    run_test(gte_2);
+    run_test(gte_3);
+    run_test(neq_1);
+    run_test(index_1);
+    run_test(index_2);
+    run_test(arcvm_api_1);
+    run_test(brz_1);
+    run_test(brnz_1);
+    run_test(branch_1);
+    run_test(branch_2);
+    run_test(branch_3);
+    run_test(function_call_1);
+    run_test(function_call_2);
+    run_test(function_call_3);
+    run_test(function_call_4);
+    run_test(CF_cleanup_1);
+    run_test(negate_1);
+    run_test(dup_1);
+    run_test(expr_1);
+    run_test(phi_1);
+    run_test(phi_2);
+    run_test(phi_3);
+    run_test(loop_1);
+    run_test(registers_1);
+    run_test(alloc_1);
+    run_test(fusion_1);
+    run_test(load_op_store_1);
+    run_test(modules_1);
+    run_test(threads_1);
+    run_test(profile_1);
+    run_test(profile_2);
+    run_test(tiered_1);
+    run_test(tail_call_1);
+    run_test(tail_call_alloc_1);
+    run_test(tail_call_alloc_2);
+    run_test(tail_call_2);
+    run_test(constants_1);
+    run_test(memo_1);
+#ifdef ARCVM_TRACE
+    run_test(trace_1);
+#endif
+    run_test(batch_1);
+    run_test(memory_widths_1);
+    run_test(ir_arena_1);
+    run_test(small_vector_1);
+    run_test(symbols_1);
+    run_test(entry_columns_1);
+    run_test(def_use_1);
+    run_test(entry_edits_1);
+    run_test(entry_edits_2);
+    run_test(block_insertion_1);
+    run_test(run_function_1);
+    run_test(decode_twice_1);
+    run_test(tiered_2);
 /*
 */
 